@@ -0,0 +1,11 @@
+#version 430 core
+
+// Triángulo que cubre la pantalla, sin buffers: se dibuja con 3 vértices
+out vec2 ScreenUV;
+
+void main()
+{
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    ScreenUV = pos;
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,42 @@
+#version 430 core
+
+// Pase de geometría del modo diferido: solo material y normal, sin luces.
+// Permutaciones: TEXTURED (color de BaseColor) y GAMMA, inyectados por el programa
+#ifndef GAMMA
+#define GAMMA 2.2
+#endif
+
+in vec3 FragNormal;
+in vec3 FragPos;
+in vec2 FragUV;
+in float FragViewDepth;
+
+layout(location = 0) out vec4 GAlbedo; // RGBA8: rgb = raíz cuadrada del albedo lineal
+layout(location = 1) out vec2 GNormal; // RG16: normal octaédrica en [0, 1]
+
+uniform sampler2D BaseColor;
+uniform vec3 MaterialColor;
+
+// Normal unitaria -> octaedro proyectado en [-1, 1]^2
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.xy;
+}
+
+void main()
+{
+    vec3 baseColor;
+#ifdef TEXTURED
+    baseColor = texture(BaseColor, FragUV).rgb;
+    baseColor = pow(baseColor, vec3(GAMMA)); // Gamma correction
+#else
+    baseColor = MaterialColor;
+#endif
+
+    // La raíz cuadrada reparte los 8 bits mejor en los tonos oscuros
+    GAlbedo = vec4(sqrt(baseColor), 1.0);
+    GNormal = OctEncode(normalize(FragNormal)) * 0.5 + 0.5;
+}
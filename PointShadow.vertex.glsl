@@ -0,0 +1,24 @@
+#version 430 core
+#ifdef USE_VERTEX_LAYER
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
+
+// Sombras de luces puntuales: cada instancia proyecta el objeto sobre una cara
+// del cubo de la luz. Con USE_VERTEX_LAYER la instancia elige su capa del
+// cube map array; sin la extensión el programa dibuja una cara por pase
+
+layout(location = 0) in vec3 in_Position;
+
+uniform mat4 ModelMatrix;
+uniform mat4 FaceMatrices[6]; // Proyección * vista de cada cara (+X, -X, +Y, -Y, +Z, -Z)
+uniform int Faces[6];         // Cara de cada instancia (solo las que ven al objeto)
+uniform int LightLayer;       // Primera capa de la luz en el array (luz * 6)
+
+void main()
+{
+    int face = Faces[gl_InstanceID];
+    gl_Position = FaceMatrices[face] * ModelMatrix * vec4(in_Position, 1.0);
+#ifdef USE_VERTEX_LAYER
+    gl_Layer = LightLayer + face;
+#endif
+}
@@ -0,0 +1,117 @@
+#version 430 core
+
+// Máscara de sombra en espacio de pantalla: una evaluación por píxel visible.
+// Pocas lecturas por frame (Poisson rotado por píxel y por frame) que se
+// acumulan con las de frames anteriores reproyectadas
+
+in vec2 ScreenUV;
+
+out float ShadowMask; // 0 = iluminado, 1 = sombra completa
+
+uniform sampler2D SceneDepth;            // Profundidad del frame actual
+uniform sampler2D PrevSceneDepth;        // Profundidad del frame anterior
+uniform sampler2D PrevShadowMask;        // Máscara acumulada del frame anterior
+uniform sampler2DArrayShadow ShadowMap;  // Cascadas del sol
+
+#define MAX_CASCADES 4
+uniform mat4 CascadeMatrices[MAX_CASCADES];
+uniform float CascadeSplits[MAX_CASCADES];
+uniform int CascadeCount;
+
+uniform mat4 ViewMatrix;
+uniform mat4 InverseViewProjection;      // Del frame actual
+uniform mat4 PrevViewProjection;         // Del frame anterior (reproyección)
+uniform mat4 PrevInverseViewProjection;
+uniform int FrameIndex;                  // Cambia la rotación de las lecturas cada frame
+uniform float HistoryBlend;              // Peso del frame actual (0.1 = converge en ~10 frames)
+uniform bool HistoryValid;
+
+const int TAPS_PER_FRAME = 4;
+const float HISTORY_MAX_DISTANCE = 0.05; // Distancia en mundo para aceptar la historia
+
+const vec2 PoissonDisk[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2( 0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2( 0.34495938,  0.29387760),
+    vec2(-0.91588581,  0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543,  0.27676845), vec2( 0.97484398,  0.75648379),
+    vec2( 0.44323325, -0.97511554), vec2( 0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2( 0.79197514,  0.19090188),
+    vec2(-0.24188840,  0.99706507), vec2(-0.81409955,  0.91437590),
+    vec2( 0.19984126,  0.78641367), vec2( 0.14383161, -0.14100790)
+);
+
+vec3 ReconstructPosition(mat4 inverseViewProjection, vec2 uv, float depth)
+{
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return world.xyz / world.w;
+}
+
+void main()
+{
+    float depth = texture(SceneDepth, ScreenUV).r;
+
+    vec3 worldPos = ReconstructPosition(InverseViewProjection, ScreenUV, depth);
+
+    if (depth >= 1.0)
+    {
+        ShadowMask = 0.0; // Fondo: nada que sombrear
+        return;
+    }
+    float viewDepth = -(ViewMatrix * vec4(worldPos, 1.0)).z;
+
+    // Cascada por profundidad de vista (la acumulación suaviza las costuras)
+    int cascade = 0;
+    while (cascade < CascadeCount && viewDepth > CascadeSplits[cascade])
+        cascade++;
+
+    float current = 0.0;
+    float tapMin = 1.0, tapMax = 0.0;
+    if (cascade < CascadeCount)
+    {
+        vec4 lightClip = CascadeMatrices[cascade] * vec4(worldPos, 1.0);
+        vec3 projCoords = lightClip.xyz / lightClip.w * 0.5 + 0.5;
+        vec2 texelSize = 1.0 / vec2(textureSize(ShadowMap, 0).xy);
+
+        // Rotación por píxel (ruido de gradiente entrelazado) + ángulo áureo por frame
+        float noise = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+        float angle = 6.2831853 * noise + 2.3999632 * float(FrameIndex);
+        mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+        int first = (FrameIndex * TAPS_PER_FRAME) & 15;
+
+        for (int i = 0; i < TAPS_PER_FRAME; ++i)
+        {
+            vec2 offset = rotation * PoissonDisk[(first + i) & 15] * 2.0 * texelSize;
+            float tap = 1.0 - texture(ShadowMap, vec4(projCoords.xy + offset, float(cascade), projCoords.z));
+            current += tap;
+            tapMin = min(tapMin, tap);
+            tapMax = max(tapMax, tap);
+        }
+        current /= float(TAPS_PER_FRAME);
+    }
+    else
+        tapMin = 0.0;
+
+    // Reproyección: aceptar la historia solo si en esa posición del frame
+    // anterior había la misma superficie
+    float result = current;
+    if (HistoryValid)
+    {
+        vec4 prevClip = PrevViewProjection * vec4(worldPos, 1.0);
+        vec2 prevUV = prevClip.xy / prevClip.w * 0.5 + 0.5;
+        if (all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0))))
+        {
+            float prevDepth = texture(PrevSceneDepth, prevUV).r;
+            vec3 prevPos = ReconstructPosition(PrevInverseViewProjection, prevUV, prevDepth);
+            if (distance(prevPos, worldPos) < HISTORY_MAX_DISTANCE)
+            {
+                // Limitar la historia al rango de las lecturas actuales (con margen)
+                // para que las sombras en movimiento no dejen estela
+                float history = texture(PrevShadowMask, prevUV).r;
+                history = clamp(history, tapMin - 0.25, tapMax + 0.25);
+                result = mix(history, current, HistoryBlend);
+            }
+        }
+    }
+
+    ShadowMask = result;
+}
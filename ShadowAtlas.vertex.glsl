@@ -0,0 +1,40 @@
+#version 430 core
+#ifdef USE_VIEWPORT_INDEX
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
+
+// Sombras de focos en el atlas: cada instancia proyecta el objeto desde un
+// foco del lote. Con USE_VIEWPORT_INDEX la instancia elige su viewport (tile);
+// sin la extensión el programa dibuja un foco por pase con glViewport
+
+layout(location = 0) in vec3 in_Position;
+
+#define MAX_SPOT_LIGHTS 64 // Debe coincidir con MAX_SPOT_LIGHTS en main.cpp
+#define SPOT_BATCH_MAX 16
+
+struct SpotLightData
+{
+    mat4 matrix;         // Proyección * vista del foco
+    vec4 positionRange;  // xyz posición, w alcance
+    vec4 directionCos;   // xyz dirección, w coseno del ángulo exterior
+    vec4 color;          // rgb color, w coseno del ángulo interior
+    vec4 atlasRect;      // xy origen, zw tamaño en el atlas
+};
+
+layout(std140, binding = 0) uniform SpotLightBlock
+{
+    SpotLightData SpotLights[MAX_SPOT_LIGHTS];
+};
+
+uniform mat4 ModelMatrix;
+uniform int BatchSlots[SPOT_BATCH_MAX]; // Slot (viewport) de cada instancia
+uniform int SlotLights[SPOT_BATCH_MAX]; // Foco de cada slot del lote
+
+void main()
+{
+    int slot = BatchSlots[gl_InstanceID];
+    gl_Position = SpotLights[SlotLights[slot]].matrix * ModelMatrix * vec4(in_Position, 1.0);
+#ifdef USE_VIEWPORT_INDEX
+    gl_ViewportIndex = slot;
+#endif
+}
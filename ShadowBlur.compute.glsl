@@ -0,0 +1,49 @@
+#version 430 core
+
+// Desenfoque separable de los momentos EVSM (una capa por cascada en z).
+// Primera pasada (BLUR_FROM_DEPTH): lee el mapa de profundidad, convierte cada
+// muestra a momentos exponenciales y desenfoca en X. Segunda pasada: desenfoca
+// los momentos en Y. Los momentos son lineales, así que filtrarlos es válido.
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+#ifdef BLUR_FROM_DEPTH
+uniform sampler2DArray ShadowDepth; // Leído con un sampler sin comparación
+uniform vec2 EvsmExponents;         // Exponentes positivo / negativo
+
+// Profundidad [0,1] -> momentos (e^(c+ d), e^(2c+ d), -e^(-c- d), e^(-2c- d))
+vec4 DepthToMoments(float depth)
+{
+    depth = 2.0 * depth - 1.0;
+    float pos = exp(EvsmExponents.x * depth);
+    float neg = -exp(-EvsmExponents.y * depth);
+    return vec4(pos, pos * pos, neg, neg * neg);
+}
+#else
+layout(rgba32f, binding = 0) readonly uniform image2DArray Source;
+#endif
+
+layout(rgba32f, binding = 1) writeonly uniform image2DArray Destination;
+
+uniform ivec2 Direction; // (1,0) horizontal, (0,1) vertical
+uniform int BlurRadius;  // Caja de 2r+1 texels
+
+void main()
+{
+    ivec3 texel = ivec3(gl_GlobalInvocationID);
+    ivec2 size = imageSize(Destination).xy;
+    if (texel.x >= size.x || texel.y >= size.y)
+        return;
+
+    vec4 sum = vec4(0.0);
+    for (int i = -BlurRadius; i <= BlurRadius; ++i)
+    {
+        ivec2 p = clamp(texel.xy + Direction * i, ivec2(0), size - 1);
+#ifdef BLUR_FROM_DEPTH
+        sum += DepthToMoments(texelFetch(ShadowDepth, ivec3(p, texel.z), 0).r);
+#else
+        sum += imageLoad(Source, ivec3(p, texel.z));
+#endif
+    }
+
+    imageStore(Destination, texel, sum / float(2 * BlurRadius + 1));
+}
@@ -1,9 +1,57 @@
 #version 430 core
 
+// Permutaciones: el programa inyecta estos defines tras #version según la
+// clave de la variante (MainShaderKey en main.cpp). Los valores por defecto
+// solo sirven para compilar el archivo suelto
+#ifndef SPOT_LIGHT_COUNT
+#define SPOT_LIGHT_COUNT 0   // Focos con sombra (cota del bucle)
+#endif
+#ifndef POINT_LIGHT_COUNT
+#define POINT_LIGHT_COUNT 0  // Luces puntuales con sombra (cota del bucle)
+#endif
+#ifndef SHININESS
+#define SHININESS 32.0       // Exponente de Phong
+#endif
+#ifndef GAMMA
+#define GAMMA 2.2            // Gamma de la textura y de la salida
+#endif
+#ifndef PCF_RADIUS
+#define PCF_RADIUS 1         // Radio del kernel PCF de SHADOW_QUALITY 2 (1 = 3x3)
+#endif
+// TEXTURED: color base de BaseColor (si no, MaterialColor)
+// SHADOW_MASK: sombra del sol leída de la máscara de pantalla (ScreenShadow)
+// CLUSTERED: suma las luces sin sombra de la rejilla de clusters
+// DEFERRED_LIGHTING: los datos del fragmento salen del G-buffer
+// LIGHTMAPPED: sol horneado en el lightmap con las UV de la malla (receptores estáticos)
+
+#ifdef DEFERRED_LIGHTING
+// Pase de iluminación diferida: los datos del fragmento salen del G-buffer
+in vec2 ScreenUV;
+
+uniform sampler2D GBufferAlbedo; // rgb = raíz cuadrada del albedo lineal
+uniform sampler2D GBufferNormal; // Normal octaédrica llevada a [0, 1]
+uniform sampler2D GBufferDepth;
+uniform mat4 ViewMatrix;
+uniform mat4 InverseViewProjection;
+
+vec3 FragNormal;
+vec3 FragPos;
+vec2 FragUV;
+float FragViewDepth;
+
+vec3 OctDecode(vec2 e) // Inversa de OctEncode (GBuffer.fragment.glsl)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+#else
 in vec3 FragNormal;
 in vec3 FragPos;
 in vec2 FragUV;
-in vec4 FragPosLightSpace;
+in float FragViewDepth;
+#endif
 
 out vec4 FragColor;
 
@@ -14,13 +62,199 @@ uniform vec3 MaterialColor;
 uniform vec3 ViewPos;
 
 uniform sampler2D BaseColor;
-uniform sampler2D ShadowMap;
+uniform sampler2DArrayShadow ShadowMap; // Una capa por cascada, comparación por hardware
+
+#define MAX_CASCADES 4
+uniform mat4 CascadeMatrices[MAX_CASCADES]; // Proyección * vista de la luz por cascada
+uniform float CascadeSplits[MAX_CASCADES];  // Profundidad de vista donde termina cada cascada
+uniform int CascadeCount;
 
-uniform bool UseTexture;
+// Focos con sombra en el atlas compartido
+#define MAX_SPOT_LIGHTS 64 // Debe coincidir con MAX_SPOT_LIGHTS en main.cpp
 
-// Calcular sombra MEJORADO
-float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
+struct SpotLightData
 {
+    mat4 matrix;         // Proyección * vista del foco
+    vec4 positionRange;  // xyz posición, w alcance
+    vec4 directionCos;   // xyz dirección, w coseno del ángulo exterior
+    vec4 color;          // rgb color, w coseno del ángulo interior
+    vec4 atlasRect;      // xy origen, zw tamaño en el atlas
+};
+
+layout(std140, binding = 0) uniform SpotLightBlock
+{
+    SpotLightData SpotLights[MAX_SPOT_LIGHTS];
+};
+
+uniform sampler2DShadow SpotShadowAtlas;
+
+#define MAX_POINT_LIGHTS 8 // Debe coincidir con MAX_POINT_LIGHTS en main.cpp
+#define POINT_SHADOW_NEAR 0.1
+
+uniform vec4 PointLightPositionRange[MAX_POINT_LIGHTS]; // xyz posición, w alcance
+uniform vec3 PointLightColor[MAX_POINT_LIGHTS];
+uniform samplerCubeArrayShadow PointShadowMaps; // Seis capas (caras) por luz
+
+// Luces sin sombra del camino clustered: rejilla de tiles de pantalla por cortes
+// exponenciales de profundidad, con la lista de luces de cada cluster
+struct ClusterLightData
+{
+    vec4 positionRange;  // xyz posición, w alcance
+    vec4 color;          // rgb color, w coseno del ángulo interior
+    vec4 directionCos;   // xyz dirección, w coseno del ángulo exterior (-2 = puntual)
+};
+
+layout(std430, binding = 1) readonly buffer ClusterLightBlock
+{
+    ClusterLightData ClusterLights[];
+};
+
+layout(std430, binding = 2) readonly buffer ClusterRangeBlock
+{
+    uvec2 ClusterRanges[]; // (offset, cantidad) en ClusterLightIndices por cluster
+};
+
+layout(std430, binding = 3) readonly buffer ClusterIndexBlock
+{
+    uint ClusterLightIndices[];
+};
+
+uniform ivec3 ClusterGrid;       // Tiles x, tiles y, cortes de profundidad
+uniform vec2 ClusterScale;       // Tiles por píxel
+uniform float ClusterNear;       // Profundidad del primer corte
+uniform float ClusterDepthScale; // Cortes por unidad de log(profundidad / ClusterNear)
+
+#ifdef LIGHTMAPPED
+uniform sampler2D Lightmap; // r = N·L * visibilidad del sol, g = visibilidad (sombras horneadas)
+#endif
+
+#ifdef SHADOW_MASK
+uniform sampler2D ShadowMask;  // Sombra del sol ya resuelta en pantalla: 0 = iluminado, 1 = en sombra
+#endif
+
+const float CascadeBlendBand = 0.1; // Fracción final de cada cascada que se mezcla con la siguiente
+
+// Calidad del filtro (la fija el programa al compilar la variante):
+// 0 = 1 lectura bilineal, 1 = 3x3 con 4 textureGather, 2 = 9 lecturas bilineales, 3 = Poisson 16,
+// 4 = EVSM (momentos exponenciales desenfocados, una lectura trilineal)
+#ifndef SHADOW_QUALITY
+#define SHADOW_QUALITY 1
+#endif
+
+#if SHADOW_QUALITY == 4
+uniform sampler2DArray ShadowMoments; // (e^(c+ d), e^(2c+ d), -e^(-c- d), e^(-2c- d)) por cascada
+uniform vec2 EvsmExponents;           // Exponentes positivo / negativo
+uniform float EvsmBleedReduction;     // Recorte de la cola de Chebyshev (light bleeding)
+uniform float EvsmVarianceBias;       // Varianza mínima relativa
+
+// Derivadas de FragPos tomadas en flujo uniforme (main): la búsqueda en los
+// mipmaps ocurre dentro de ramas y necesita gradientes explícitos
+vec3 FragPosDx, FragPosDy;
+
+// Cota de Chebyshev: probabilidad de que la profundidad almacenada sea >= depth
+float Chebyshev(vec2 moments, float depth, float minVariance)
+{
+    if (depth <= moments.x)
+        return 1.0;
+
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    float pMax = variance / (variance + d * d);
+
+    // Reducción de light bleeding: descartar la cola baja y reescalar
+    return clamp((pMax - EvsmBleedReduction) / (1.0 - EvsmBleedReduction), 0.0, 1.0);
+}
+#endif
+
+#if SHADOW_QUALITY == 3
+const vec2 PoissonDisk[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2( 0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2( 0.34495938,  0.29387760),
+    vec2(-0.91588581,  0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543,  0.27676845), vec2( 0.97484398,  0.75648379),
+    vec2( 0.44323325, -0.97511554), vec2( 0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2( 0.79197514,  0.19090188),
+    vec2(-0.24188840,  0.99706507), vec2(-0.81409955,  0.91437590),
+    vec2( 0.19984126,  0.78641367), vec2( 0.14383161, -0.14100790)
+);
+#endif
+
+// Fracción iluminada (1 = sin sombra) filtrada con el kernel de la variante
+float FilterShadow(vec2 uv, float layer, float refDepth)
+{
+#if SHADOW_QUALITY != 4
+    vec2 size = vec2(textureSize(ShadowMap, 0).xy);
+    vec2 texelSize = 1.0 / size;
+#endif
+
+#if SHADOW_QUALITY == 0
+    // Una lectura: el hardware compara y filtra 2x2 texels
+    return texture(ShadowMap, vec4(uv, layer, refDepth));
+
+#elif SHADOW_QUALITY == 1
+    // Equivalente a 3x3 lecturas bilineales con 4 textureGather (4x4 texels
+    // con pesos fraccionarios en los bordes)
+    vec2 texelPos = uv * size - 0.5;
+    vec2 base = floor(texelPos);
+    vec2 f = texelPos - base;
+
+    // Pesos por columna/fila para texels base-1, base, base+1, base+2
+    vec4 wx = vec4(1.0 - f.x, 1.0, 1.0, f.x);
+    vec4 wy = vec4(1.0 - f.y, 1.0, 1.0, f.y);
+
+    // Cada gather devuelve (x: [0,1], y: [1,1], z: [1,0], w: [0,0]) del bloque 2x2
+    vec4 g00 = textureGather(ShadowMap, vec3((base + vec2(0.0, 0.0)) * texelSize, layer), refDepth);
+    vec4 g10 = textureGather(ShadowMap, vec3((base + vec2(2.0, 0.0)) * texelSize, layer), refDepth);
+    vec4 g01 = textureGather(ShadowMap, vec3((base + vec2(0.0, 2.0)) * texelSize, layer), refDepth);
+    vec4 g11 = textureGather(ShadowMap, vec3((base + vec2(2.0, 2.0)) * texelSize, layer), refDepth);
+
+    float lit = 0.0;
+    lit += dot(vec4(g00.w * wx.x, g00.z * wx.y, g00.x * wx.x, g00.y * wx.y), vec4(wy.x, wy.x, wy.y, wy.y));
+    lit += dot(vec4(g10.w * wx.z, g10.z * wx.w, g10.x * wx.z, g10.y * wx.w), vec4(wy.x, wy.x, wy.y, wy.y));
+    lit += dot(vec4(g01.w * wx.x, g01.z * wx.y, g01.x * wx.x, g01.y * wx.y), vec4(wy.z, wy.z, wy.w, wy.w));
+    lit += dot(vec4(g11.w * wx.z, g11.z * wx.w, g11.x * wx.z, g11.y * wx.w), vec4(wy.z, wy.z, wy.w, wy.w));
+    return lit / 9.0;
+
+#elif SHADOW_QUALITY == 2
+    // (2 * PCF_RADIUS + 1)^2 lecturas con comparación bilineal
+    float lit = 0.0;
+    for(int x = -PCF_RADIUS; x <= PCF_RADIUS; ++x)
+        for(int y = -PCF_RADIUS; y <= PCF_RADIUS; ++y)
+            lit += texture(ShadowMap, vec4(uv + vec2(x, y) * texelSize, layer, refDepth));
+    return lit / float((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1));
+
+#elif SHADOW_QUALITY == 3
+    // Poisson de 16 lecturas, rotado por píxel para cambiar banding por ruido
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    float lit = 0.0;
+    for(int i = 0; i < 16; ++i)
+        lit += texture(ShadowMap, vec4(uv + rotation * PoissonDisk[i] * 2.0 * texelSize, layer, refDepth));
+    return lit / 16.0;
+
+#else
+    // Una lectura filtrada (trilineal sobre los momentos desenfocados). La
+    // proyección de la luz es ortográfica: los gradientes de uv son lineales
+    mat4 cascadeMatrix = CascadeMatrices[int(layer)];
+    vec2 uvDx = (cascadeMatrix * vec4(FragPosDx, 0.0)).xy * 0.5;
+    vec2 uvDy = (cascadeMatrix * vec4(FragPosDy, 0.0)).xy * 0.5;
+    vec4 moments = textureGrad(ShadowMoments, vec3(uv, layer), uvDx, uvDy);
+
+    float depth = 2.0 * refDepth - 1.0;
+    vec2 warped = vec2(exp(EvsmExponents.x * depth), -exp(-EvsmExponents.y * depth));
+    vec2 depthScale = EvsmVarianceBias * 0.01 * EvsmExponents * warped;
+    vec2 minVariance = depthScale * depthScale;
+
+    return min(Chebyshev(moments.xy, warped.x, minVariance.x),
+               Chebyshev(moments.zw, warped.y, minVariance.y));
+#endif
+}
+
+// Calcular sombra en una cascada
+float ShadowCalculation(int cascade, vec3 fragPos)
+{
+    vec4 fragPosLightSpace = CascadeMatrices[cascade] * vec4(fragPos, 1.0);
+
     // Perspectiva divide
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     
@@ -33,42 +267,176 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir)
        projCoords.z > 1.0)
         return 0.0;
     
-    // Obtener profundidad desde el shadow map
-    float closestDepth = texture(ShadowMap, projCoords.xy).r;
-    
-    // Profundidad actual del fragmento
-    float currentDepth = projCoords.z;
-    
-    // Bias para evitar shadow acne
-    float bias = max(0.003 * (1.0 - dot(normal, lightDir)), 0.0005);
-    
-    // PCF (suavizado de sombras) - 3x3 kernel
-    float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(ShadowMap, 0);
-    
-    for(int x = -1; x <= 1; ++x)
+    // Sin bias aquí: el pase de sombras ya aplica glPolygonOffset por pendiente
+    return 1.0 - FilterShadow(projCoords.xy, float(cascade), projCoords.z);
+}
+
+// Elegir cascada por profundidad de vista y mezclar en la banda de transición
+float CascadedShadow(vec3 fragPos)
+{
+    int cascade = 0;
+    while (cascade < CascadeCount && FragViewDepth > CascadeSplits[cascade])
+        cascade++;
+
+    if (cascade >= CascadeCount)
+        return 0.0; // Más allá de la distancia de sombras
+
+    float shadow = ShadowCalculation(cascade, fragPos);
+
+    float cascadeStart = cascade == 0 ? 0.0 : CascadeSplits[cascade - 1];
+    float cascadeEnd = CascadeSplits[cascade];
+    float blendStart = cascadeEnd - (cascadeEnd - cascadeStart) * CascadeBlendBand;
+
+    if (FragViewDepth > blendStart)
     {
-        for(int y = -1; y <= 1; ++y)
-        {
-            float pcfDepth = texture(ShadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-            shadow += (currentDepth - bias) > pcfDepth ? 1.0 : 0.0;
-        }
+        float t = (FragViewDepth - blendStart) / (cascadeEnd - blendStart);
+        float next = cascade + 1 < CascadeCount
+                   ? ShadowCalculation(cascade + 1, fragPos)
+                   : 0.0; // La última cascada se desvanece hacia sin sombra
+        shadow = mix(shadow, next, t);
     }
-    shadow /= 9.0;
-    
+
     return shadow;
 }
 
+// Fracción iluminada de una luz puntual: una lectura con PCF bilineal en su cubo.
+// La profundidad de referencia es la de la proyección de la cara, que depende
+// solo del eje dominante de la dirección
+float PointShadow(int light, vec3 fragPos)
+{
+    vec3 lightToFrag = fragPos - PointLightPositionRange[light].xyz;
+    vec3 absDir = abs(lightToFrag);
+    float z = max(absDir.x, max(absDir.y, absDir.z));
+
+    float n = POINT_SHADOW_NEAR;
+    float f = PointLightPositionRange[light].w;
+    float ndc = (f + n) / (f - n) - 2.0 * f * n / ((f - n) * z);
+    return texture(PointShadowMaps, vec4(lightToFrag, float(light)), ndc * 0.5 + 0.5);
+}
+
+// Luz de todas las luces puntuales (difusa + especular, atenuada por distancia y sombra)
+vec3 PointLighting(vec3 fragPos, vec3 normal, vec3 viewDir, vec3 baseColor)
+{
+    vec3 result = vec3(0.0);
+    for (int i = 0; i < POINT_LIGHT_COUNT; ++i)
+    {
+        vec3 toLight = PointLightPositionRange[i].xyz - fragPos;
+        float distance = length(toLight);
+        vec3 L = toLight / distance;
+
+        float falloff = clamp(1.0 - distance / PointLightPositionRange[i].w, 0.0, 1.0);
+        float diff = max(dot(normal, L), 0.0);
+        if (falloff * diff <= 0.0)
+            continue;
+
+        vec3 reflectDir = reflect(-L, normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), SHININESS);
+
+        float visibility = PointShadow(i, fragPos);
+        result += PointLightColor[i] * falloff * falloff * visibility * (diff * baseColor + 0.5 * spec);
+    }
+    return result;
+}
+
+// Luz de las luces del cluster de este fragmento (mismo modelo que los focos, sin sombra)
+vec3 ClusteredLighting(vec3 fragPos, vec3 normal, vec3 viewDir, vec3 baseColor)
+{
+    ivec3 cluster;
+    cluster.xy = min(ivec2(gl_FragCoord.xy * ClusterScale), ClusterGrid.xy - 1);
+    cluster.z = clamp(int(log(max(FragViewDepth, ClusterNear) / ClusterNear) * ClusterDepthScale), 0, ClusterGrid.z - 1);
+    uvec2 range = ClusterRanges[(cluster.z * ClusterGrid.y + cluster.y) * ClusterGrid.x + cluster.x];
+
+    vec3 result = vec3(0.0);
+    for (uint k = 0u; k < range.y; ++k)
+    {
+        ClusterLightData light = ClusterLights[ClusterLightIndices[range.x + k]];
+        vec3 toLight = light.positionRange.xyz - fragPos;
+        float distance = length(toLight);
+        vec3 L = toLight / distance;
+
+        float falloff = clamp(1.0 - distance / light.positionRange.w, 0.0, 1.0);
+        float cone = light.directionCos.w < -1.0 ? 1.0 :
+                     smoothstep(light.directionCos.w, light.color.w, dot(-L, light.directionCos.xyz));
+        float diff = max(dot(normal, L), 0.0);
+        float attenuation = cone * falloff * falloff;
+        if (attenuation * diff <= 0.0)
+            continue;
+
+        vec3 reflectDir = reflect(-L, normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), SHININESS);
+        result += light.color.rgb * attenuation * (diff * baseColor + 0.5 * spec);
+    }
+    return result;
+}
+
+// Fracción iluminada de un foco: una lectura con PCF bilineal en su tile
+float SpotShadow(int light, vec3 fragPos)
+{
+    vec4 lightClip = SpotLights[light].matrix * vec4(fragPos, 1.0);
+    vec3 projCoords = lightClip.xyz / lightClip.w * 0.5 + 0.5;
+    if (projCoords.z > 1.0)
+        return 1.0;
+
+    // Recortar al tile (medio texel de margen) para no leer del vecino
+    vec4 rect = SpotLights[light].atlasRect;
+    vec2 halfTexel = 0.5 / vec2(textureSize(SpotShadowAtlas, 0));
+    vec2 uv = rect.xy + clamp(projCoords.xy, vec2(0.0), vec2(1.0)) * rect.zw;
+    uv = clamp(uv, rect.xy + halfTexel, rect.xy + rect.zw - halfTexel);
+
+    return texture(SpotShadowAtlas, vec3(uv, projCoords.z));
+}
+
+// Luz de todos los focos (difusa + especular, atenuada por cono, distancia y sombra)
+vec3 SpotLighting(vec3 fragPos, vec3 normal, vec3 viewDir, vec3 baseColor)
+{
+    vec3 result = vec3(0.0);
+    for (int i = 0; i < SPOT_LIGHT_COUNT; ++i)
+    {
+        vec3 toLight = SpotLights[i].positionRange.xyz - fragPos;
+        float distance = length(toLight);
+        vec3 L = toLight / distance;
+
+        float range = SpotLights[i].positionRange.w;
+        float cosAngle = dot(-L, SpotLights[i].directionCos.xyz);
+        float cone = smoothstep(SpotLights[i].directionCos.w, SpotLights[i].color.w, cosAngle);
+        float falloff = clamp(1.0 - distance / range, 0.0, 1.0);
+        float diff = max(dot(normal, L), 0.0);
+        float attenuation = cone * falloff * falloff;
+        if (attenuation * diff <= 0.0)
+            continue;
+
+        vec3 reflectDir = reflect(-L, normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), SHININESS);
+
+        float visibility = SpotShadow(i, fragPos);
+        result += SpotLights[i].color.rgb * attenuation * visibility * (diff * baseColor + 0.5 * spec);
+    }
+    return result;
+}
+
 void main()
 {
     // Obtener color base
     vec3 baseColor;
-    if (UseTexture) {
-        baseColor = texture(BaseColor, FragUV).rgb;
-        baseColor = pow(baseColor, vec3(2.2)); // Gamma correction
-    } else {
-        baseColor = MaterialColor;
-    }
+#ifdef DEFERRED_LIGHTING
+    // Reconstruir posición desde la profundidad. El fondo se sombrea igual
+    // (sin saltos que rompan las derivadas) y se descarta al final
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(GBufferDepth, pixel, 0).r;
+    vec4 world = InverseViewProjection * vec4(vec3(ScreenUV, depth) * 2.0 - 1.0, 1.0);
+    FragPos = world.xyz / world.w;
+    FragNormal = OctDecode(texelFetch(GBufferNormal, pixel, 0).xy * 2.0 - 1.0);
+    FragViewDepth = -(ViewMatrix * vec4(FragPos, 1.0)).z;
+    FragUV = ScreenUV;
+
+    vec3 albedo = texelFetch(GBufferAlbedo, pixel, 0).rgb;
+    baseColor = albedo * albedo;
+#elif defined(TEXTURED)
+    baseColor = texture(BaseColor, FragUV).rgb;
+    baseColor = pow(baseColor, vec3(GAMMA)); // Gamma correction
+#else
+    baseColor = MaterialColor;
+#endif
     
     // Normalizar vectores
     vec3 normal = normalize(FragNormal);
@@ -84,18 +452,45 @@ void main()
     
     // ESPECULAR (Phong)
     vec3 reflectDir = reflect(-lightDir, normal);
-    float shininess = 32.0;
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), SHININESS);
     vec3 specular = spec * LightColor * 0.5;
     
+#ifdef LIGHTMAPPED
+    // Sol horneado: difusa con penumbra y visibilidad para la especular, una lectura
+    vec2 baked = texture(Lightmap, FragUV).rg;
+    vec3 lighting = ambient + LightColor * (baked.r * baseColor + baked.g * 0.5 * spec);
+#else
     // CALCULAR SOMBRA
-    float shadow = ShadowCalculation(FragPosLightSpace, normal, lightDir);
+#ifdef SHADOW_MASK
+    float shadow = texelFetch(ShadowMask, ivec2(gl_FragCoord.xy), 0).r;
+#else
+#if SHADOW_QUALITY == 4
+    FragPosDx = dFdx(FragPos);
+    FragPosDy = dFdy(FragPos);
+#endif
+    float shadow = CascadedShadow(FragPos);
+#endif
     
     // COMBINAR (sombra NO afecta ambiente, solo difusa y especular)
     vec3 lighting = ambient + (1.0 - shadow * 0.85) * (diffuse + specular); // Sombras más oscuras (85%)
+#endif
+#if SPOT_LIGHT_COUNT > 0
+    lighting += SpotLighting(FragPos, normal, viewDir, baseColor);
+#endif
+#if POINT_LIGHT_COUNT > 0
+    lighting += PointLighting(FragPos, normal, viewDir, baseColor);
+#endif
+#ifdef CLUSTERED
+    lighting += ClusteredLighting(FragPos, normal, viewDir, baseColor);
+#endif
     
     // Gamma correction final
-    vec3 result = pow(lighting, vec3(1.0/2.2));
+    vec3 result = pow(lighting, vec3(1.0 / GAMMA));
     
     FragColor = vec4(result, 1.0);
+
+#ifdef DEFERRED_LIGHTING
+    if (depth == 1.0)
+        discard; // Sin geometría: queda el color de limpieza
+#endif
 }
@@ -7,12 +7,14 @@ layout(location = 2) in vec2 in_UV;
 out vec3 FragNormal;
 out vec3 FragPos;
 out vec2 FragUV;
-out vec4 FragPosLightSpace;
+out float FragViewDepth;
 
 uniform mat4 ModelMatrix;
 uniform mat4 ViewMatrix;
 uniform mat4 ProjectionMatrix;
-uniform mat4 LightSpaceMatrix;
+
+// Misma profundidad en el pre-pase y en el pase principal (GL_EQUAL)
+invariant gl_Position;
 
 void main()
 {
@@ -25,8 +27,8 @@ void main()
     // Coordenadas UV
     FragUV = in_UV;
     
-    // Posición en espacio de luz para sombras
-    FragPosLightSpace = LightSpaceMatrix * vec4(FragPos, 1.0);
+    // Profundidad en espacio de vista para elegir la cascada de sombra
+    FragViewDepth = -(ViewMatrix * vec4(FragPos, 1.0)).z;
     
     // Posición final del vértice
     gl_Position = ProjectionMatrix * ViewMatrix * vec4(FragPos, 1.0);
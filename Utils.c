@@ -1,5 +1,10 @@
 #include "Utils.h" // Incluye el archivo de cabecera Utils.h
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h> // Para SSE (distancia de cuatro píxeles a la paleta por instrucción)
+#define TEXTURE_SIMD 1
+#endif
+
 const Matrix IDENTITY_MATRIX = {{ // Definición de la matriz identidad
     1, 0, 0, 0,
     0, 1, 0, 0,
@@ -126,6 +131,524 @@ out.m[14] = -((2 * near_plane * far_plane) / frustum_length);
 return out;
 }
 
+Matrix CreateOrthographicMatrix( // Función para crear una matriz de proyección ortográfica
+float left,
+float right,
+float bottom,
+float top,
+float near_plane,
+float far_plane
+)
+{
+Matrix out = IDENTITY_MATRIX;
+
+out.m[0] = 2.0f / (right - left);
+out.m[5] = 2.0f / (top - bottom);
+out.m[10] = -2.0f / (far_plane - near_plane);
+out.m[12] = -(right + left) / (right - left);
+out.m[13] = -(top + bottom) / (top - bottom);
+out.m[14] = -(far_plane + near_plane) / (far_plane - near_plane);
+
+return out;
+}
+
+Matrix CreateLookAtMatrix(const float eye[3], const float center[3], const float up[3]) // Función para crear una matriz de vista (cámara en eye mirando a center)
+{
+    float f[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+    float flen = sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+    f[0] /= flen; f[1] /= flen; f[2] /= flen;
+
+    // s = f x up
+    float s[3] = {
+        f[1] * up[2] - f[2] * up[1],
+        f[2] * up[0] - f[0] * up[2],
+        f[0] * up[1] - f[1] * up[0]
+    };
+    float slen = sqrtf(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+    s[0] /= slen; s[1] /= slen; s[2] /= slen;
+
+    // u = s x f
+    float u[3] = {
+        s[1] * f[2] - s[2] * f[1],
+        s[2] * f[0] - s[0] * f[2],
+        s[0] * f[1] - s[1] * f[0]
+    };
+
+    Matrix out = IDENTITY_MATRIX;
+    out.m[0] = s[0]; out.m[4] = s[1]; out.m[8]  = s[2];
+    out.m[1] = u[0]; out.m[5] = u[1]; out.m[9]  = u[2];
+    out.m[2] = -f[0]; out.m[6] = -f[1]; out.m[10] = -f[2];
+    out.m[12] = -(s[0] * eye[0] + s[1] * eye[1] + s[2] * eye[2]);
+    out.m[13] = -(u[0] * eye[0] + u[1] * eye[1] + u[2] * eye[2]);
+    out.m[14] = (f[0] * eye[0] + f[1] * eye[1] + f[2] * eye[2]);
+
+    return out;
+}
+
+Matrix InvertMatrix(const Matrix* m) // Función para invertir una matriz 4x4 (cofactores)
+{
+    const float* a = m->m;
+    Matrix inv;
+    float* r = inv.m;
+
+    r[0]  =  a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+    r[4]  = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+    r[8]  =  a[4] * a[9]  * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+    r[12] = -a[4] * a[9]  * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+    r[1]  = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+    r[5]  =  a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+    r[9]  = -a[0] * a[9]  * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+    r[13] =  a[0] * a[9]  * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+    r[2]  =  a[1] * a[6]  * a[15] - a[1] * a[7]  * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7]  - a[13] * a[3] * a[6];
+    r[6]  = -a[0] * a[6]  * a[15] + a[0] * a[7]  * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7]  + a[12] * a[3] * a[6];
+    r[10] =  a[0] * a[5]  * a[15] - a[0] * a[7]  * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7]  - a[12] * a[3] * a[5];
+    r[14] = -a[0] * a[5]  * a[14] + a[0] * a[6]  * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6]  + a[12] * a[2] * a[5];
+    r[3]  = -a[1] * a[6]  * a[11] + a[1] * a[7]  * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9]  * a[2] * a[7]  + a[9]  * a[3] * a[6];
+    r[7]  =  a[0] * a[6]  * a[11] - a[0] * a[7]  * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8]  * a[2] * a[7]  - a[8]  * a[3] * a[6];
+    r[11] = -a[0] * a[5]  * a[11] + a[0] * a[7]  * a[9]  + a[4] * a[1] * a[11] - a[4] * a[3] * a[9]  - a[8]  * a[1] * a[7]  + a[8]  * a[3] * a[5];
+    r[15] =  a[0] * a[5]  * a[10] - a[0] * a[6]  * a[9]  - a[4] * a[1] * a[10] + a[4] * a[2] * a[9]  + a[8]  * a[1] * a[6]  - a[8]  * a[2] * a[5];
+
+    float det = a[0] * r[0] + a[1] * r[4] + a[2] * r[8] + a[3] * r[12];
+    if (det == 0.0f)
+        return IDENTITY_MATRIX;
+
+    float invDet = 1.0f / det;
+    for (int i = 0; i < 16; i++)
+        r[i] *= invDet;
+
+    return inv;
+}
+
+void TransformPoint(const Matrix* m, const float in[3], float out[3]) // Función para transformar un punto (con división por w)
+{
+    float x = m->m[0] * in[0] + m->m[4] * in[1] + m->m[8]  * in[2] + m->m[12];
+    float y = m->m[1] * in[0] + m->m[5] * in[1] + m->m[9]  * in[2] + m->m[13];
+    float z = m->m[2] * in[0] + m->m[6] * in[1] + m->m[10] * in[2] + m->m[14];
+    float w = m->m[3] * in[0] + m->m[7] * in[1] + m->m[11] * in[2] + m->m[15];
+
+    if (w != 0.0f && w != 1.0f) {
+        x /= w; y /= w; z /= w;
+    }
+
+    out[0] = x;
+    out[1] = y;
+    out[2] = z;
+}
+
+void TransformDirection(const Matrix* m, const float in[3], float out[3]) // Función para transformar una dirección (sin traslación)
+{
+    float x = m->m[0] * in[0] + m->m[4] * in[1] + m->m[8]  * in[2];
+    float y = m->m[1] * in[0] + m->m[5] * in[1] + m->m[9]  * in[2];
+    float z = m->m[2] * in[0] + m->m[6] * in[1] + m->m[10] * in[2];
+
+    out[0] = x;
+    out[1] = y;
+    out[2] = z;
+}
+
+void TransformAABB(const Matrix* m, const float in_min[3], const float in_max[3], float out_min[3], float out_max[3]) // Función para transformar una caja alineada (AABB de las 8 esquinas)
+{
+    out_min[0] = out_min[1] = out_min[2] = 1e30f;
+    out_max[0] = out_max[1] = out_max[2] = -1e30f;
+
+    for (int corner = 0; corner < 8; corner++)
+    {
+        float p[3] = {
+            (corner & 1) ? in_max[0] : in_min[0],
+            (corner & 2) ? in_max[1] : in_min[1],
+            (corner & 4) ? in_max[2] : in_min[2]
+        };
+        float t[3];
+        TransformPoint(m, p, t);
+
+        for (int i = 0; i < 3; i++)
+        {
+            if (t[i] < out_min[i]) out_min[i] = t[i];
+            if (t[i] > out_max[i]) out_max[i] = t[i];
+        }
+    }
+}
+
+void ExtractFrustumPlanes(const Matrix* view_projection, float planes[6][4]) // Función para extraer los 6 planos (normal hacia dentro) de una matriz de vista-proyección
+{
+    const float* m = view_projection->m;
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            planes[i * 2][k]     = m[k * 4 + 3] + m[k * 4 + i]; // izquierdo, inferior, cercano
+            planes[i * 2 + 1][k] = m[k * 4 + 3] - m[k * 4 + i]; // derecho, superior, lejano
+        }
+    }
+
+    for (int p = 0; p < 6; p++)
+    {
+        float len = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+        for (int k = 0; k < 4; k++)
+            planes[p][k] /= len;
+    }
+}
+
+int AABBIntersectsFrustum(const float planes[6][4], const float box_min[3], const float box_max[3]) // Función para probar una caja contra un frustum (conservadora)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        // Vértice más adentro según la normal del plano
+        float x = planes[p][0] >= 0.0f ? box_max[0] : box_min[0];
+        float y = planes[p][1] >= 0.0f ? box_max[1] : box_min[1];
+        float z = planes[p][2] >= 0.0f ? box_max[2] : box_min[2];
+
+        if (planes[p][0] * x + planes[p][1] * y + planes[p][2] * z + planes[p][3] < 0.0f)
+            return 0;
+    }
+    return 1;
+}
+
+int SphereIntersectsAABB(const float center[3], float radius, const float box_min[3], const float box_max[3]) // Función para probar una esfera contra una caja
+{
+    // Distancia al cuadrado desde el centro al punto más cercano de la caja
+    float distance2 = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        float v = center[i] < box_min[i] ? box_min[i] - center[i] :
+                  center[i] > box_max[i] ? center[i] - box_max[i] : 0.0f;
+        distance2 += v * v;
+    }
+    return distance2 <= radius * radius;
+}
+
+int RayIntersectsTriangle(const float origin[3], const float dir[3], const float v0[3], const float e1[3], const float e2[3], float max_t) // Función para probar un rayo contra un triángulo (Möller–Trumbore)
+{
+    // Aristas precalculadas: e1 = v1 - v0, e2 = v2 - v0
+    float p[3] = {
+        dir[1] * e2[2] - dir[2] * e2[1],
+        dir[2] * e2[0] - dir[0] * e2[2],
+        dir[0] * e2[1] - dir[1] * e2[0]
+    };
+    float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (fabsf(det) < 1e-12f)
+        return 0; // Rayo paralelo al plano
+
+    float inv_det = 1.0f / det;
+    float s[3] = { origin[0] - v0[0], origin[1] - v0[1], origin[2] - v0[2] };
+    float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return 0;
+
+    float q[3] = {
+        s[1] * e1[2] - s[2] * e1[1],
+        s[2] * e1[0] - s[0] * e1[2],
+        s[0] * e1[1] - s[1] * e1[0]
+    };
+    float v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return 0;
+
+    float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+    return t > 0.0f && t < max_t;
+}
+
+unsigned long long HashBytes(const void* data, size_t size, unsigned long long hash) // Función para acumular bytes en un hash FNV-1a
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void DownsampleRGBA(const unsigned char* src, int width, int height, unsigned char* dst) // Función para reducir una imagen RGBA8 a la mitad (caja 2x2)
+{
+    int dst_width = width > 1 ? width / 2 : 1;
+    int dst_height = height > 1 ? height / 2 : 1;
+    for (int y = 0; y < dst_height; y++)
+    {
+        int y0 = 2 * y < height ? 2 * y : height - 1;
+        int y1 = 2 * y + 1 < height ? 2 * y + 1 : height - 1;
+        for (int x = 0; x < dst_width; x++)
+        {
+            int x0 = 2 * x < width ? 2 * x : width - 1;
+            int x1 = 2 * x + 1 < width ? 2 * x + 1 : width - 1;
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c] +
+                          src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c];
+                dst[(y * dst_width + x) * 4 + c] = (unsigned char)((sum + 2) >> 2);
+            }
+        }
+    }
+}
+
+void ExtractBlockRGBA(const unsigned char* image, int width, int height, int block_x, int block_y, unsigned char block[64]) // Función para copiar un bloque de 4x4 (repitiendo el borde)
+{
+    for (int y = 0; y < 4; y++)
+    {
+        int sy = block_y * 4 + y < height ? block_y * 4 + y : height - 1;
+        for (int x = 0; x < 4; x++)
+        {
+            int sx = block_x * 4 + x < width ? block_x * 4 + x : width - 1;
+            memcpy(&block[(y * 4 + x) * 4], &image[(sy * width + sx) * 4], 4);
+        }
+    }
+}
+
+static void BlockEndpoints(const unsigned char block[64], int channels, float lo[4], float hi[4]) // Extremos del bloque sobre su eje principal
+{
+    float mean[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < channels; c++)
+            mean[c] += block[i * 4 + c] / 16.0f;
+
+    // Covarianza e iteración de potencia desde la diagonal de la caja
+    float cov[4][4] = { { 0 } };
+    float box_min[4] = { 255, 255, 255, 255 }, box_max[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        float d[4];
+        for (int c = 0; c < channels; c++)
+        {
+            d[c] = block[i * 4 + c] - mean[c];
+            box_min[c] = fminf(box_min[c], block[i * 4 + c]);
+            box_max[c] = fmaxf(box_max[c], block[i * 4 + c]);
+        }
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                cov[a][b] += d[a] * d[b];
+    }
+
+    float axis[4] = { 0, 0, 0, 0 };
+    for (int c = 0; c < channels; c++)
+        axis[c] = box_max[c] - box_min[c];
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = { 0, 0, 0, 0 };
+        float length = 0.0f;
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+                next[a] += cov[a][b] * axis[b];
+            length = fmaxf(length, fabsf(next[a]));
+        }
+        if (length < 1e-6f)
+            break; // Bloque plano: se queda la diagonal (o nada)
+        for (int c = 0; c < channels; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float length_sq = 0.0f;
+    for (int c = 0; c < channels; c++)
+        length_sq += axis[c] * axis[c];
+    float t_min = 0.0f, t_max = 0.0f;
+    if (length_sq > 1e-12f)
+    {
+        t_min = 1e30f;
+        t_max = -1e30f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < channels; c++)
+                t += (block[i * 4 + c] - mean[c]) * axis[c];
+            t_min = fminf(t_min, t);
+            t_max = fmaxf(t_max, t);
+        }
+        t_min /= length_sq;
+        t_max /= length_sq;
+    }
+
+    for (int c = 0; c < 4; c++)
+    {
+        float m = c < channels ? mean[c] : 255.0f;
+        float a = c < channels ? axis[c] : 0.0f;
+        lo[c] = fminf(fmaxf(m + t_min * a, 0.0f), 255.0f);
+        hi[c] = fminf(fmaxf(m + t_max * a, 0.0f), 255.0f);
+    }
+}
+
+static void NearestPaletteIndices(const unsigned char block[64], const float palette[16][4], int count, int channels, unsigned char indices[16]) // Índice de la entrada más cercana para cada píxel
+{
+#ifdef TEXTURE_SIMD
+    // Cuatro píxeles por instrucción: canales en SoA, distancia a cada entrada y selección por máscara
+    float soa[4][16];
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 4; c++)
+            soa[c][i] = block[i * 4 + c];
+
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128 best_index = _mm_setzero_ps();
+        for (int j = 0; j < count; j++)
+        {
+            __m128 distance = _mm_setzero_ps();
+            for (int c = 0; c < channels; c++)
+            {
+                __m128 d = _mm_sub_ps(_mm_loadu_ps(&soa[c][i]), _mm_set1_ps(palette[j][c]));
+                distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+            }
+            __m128 closer = _mm_cmplt_ps(distance, best);
+            best = _mm_min_ps(distance, best);
+            best_index = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)j)), _mm_andnot_ps(closer, best_index));
+        }
+        float result[4];
+        _mm_storeu_ps(result, best_index);
+        for (int k = 0; k < 4; k++)
+            indices[i + k] = (unsigned char)result[k];
+    }
+#else
+    for (int i = 0; i < 16; i++)
+    {
+        float best = 1e30f;
+        indices[i] = 0;
+        for (int j = 0; j < count; j++)
+        {
+            float distance = 0.0f;
+            for (int c = 0; c < channels; c++)
+            {
+                float d = block[i * 4 + c] - palette[j][c];
+                distance += d * d;
+            }
+            if (distance < best)
+            {
+                best = distance;
+                indices[i] = (unsigned char)j;
+            }
+        }
+    }
+#endif
+}
+
+static unsigned PackRGB565(const float color[4]) // Color de 8 bits por canal a 5:6:5 (redondeado)
+{
+    unsigned r = (unsigned)(color[0] * 31.0f / 255.0f + 0.5f);
+    unsigned g = (unsigned)(color[1] * 63.0f / 255.0f + 0.5f);
+    unsigned b = (unsigned)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (r << 11) | (g << 5) | b;
+}
+
+static void UnpackRGB565(unsigned packed, float color[4]) // 5:6:5 a 8 bits por canal, como lo expande la GPU
+{
+    unsigned r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (float)((r << 3) | (r >> 2));
+    color[1] = (float)((g << 2) | (g >> 4));
+    color[2] = (float)((b << 3) | (b >> 2));
+    color[3] = 255.0f;
+}
+
+void EncodeBC1Block(const unsigned char block[64], unsigned char out[8]) // Función para comprimir un bloque opaco a BC1 (4 colores)
+{
+    float lo[4], hi[4];
+    BlockEndpoints(block, 3, lo, hi);
+    unsigned c0 = PackRGB565(hi), c1 = PackRGB565(lo);
+    if (c0 < c1)
+    {
+        unsigned t = c0; c0 = c1; c1 = t; // c0 > c1 selecciona el modo de 4 colores
+    }
+    out[0] = (unsigned char)(c0 & 255);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 255);
+    out[3] = (unsigned char)(c1 >> 8);
+    if (c0 == c1)
+    {
+        memset(out + 4, 0, 4); // Un solo color: todos los píxeles usan c0
+        return;
+    }
+
+    float palette[16][4];
+    UnpackRGB565(c0, palette[0]);
+    UnpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    unsigned char indices[16];
+    NearestPaletteIndices(block, palette, 4, 3, indices);
+    unsigned bits = 0;
+    for (int i = 0; i < 16; i++)
+        bits |= (unsigned)indices[i] << (2 * i);
+    for (int k = 0; k < 4; k++)
+        out[4 + k] = (unsigned char)(bits >> (8 * k));
+}
+
+static void QuantizeBC7Endpoint(const float value[4], int endpoint[4], int* p_bit) // 7 bits por canal + bit p compartido (el de menor error)
+{
+    float best = 1e30f;
+    for (int p = 0; p < 2; p++)
+    {
+        int candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++)
+        {
+            int q = (int)floorf((value[c] - p) * 0.5f + 0.5f);
+            q = q < 0 ? 0 : (q > 127 ? 127 : q);
+            candidate[c] = (q << 1) | p;
+            error += (candidate[c] - value[c]) * (candidate[c] - value[c]);
+        }
+        if (error < best)
+        {
+            best = error;
+            memcpy(endpoint, candidate, sizeof(candidate));
+            *p_bit = p;
+        }
+    }
+}
+
+static void WriteBits(unsigned char* out, int* position, unsigned value, int count) // Escribir 'count' bits, el menos significativo primero
+{
+    for (int i = 0; i < count; i++, (*position)++)
+        if ((value >> i) & 1)
+            out[*position >> 3] |= (unsigned char)(1 << (*position & 7));
+}
+
+void EncodeBC7Block(const unsigned char block[64], unsigned char out[16]) // Función para comprimir un bloque RGBA a BC7 (modo 6: un subconjunto, índices de 4 bits)
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float lo[4], hi[4];
+    BlockEndpoints(block, 4, lo, hi);
+    int endpoints[2][4], p_bits[2];
+    QuantizeBC7Endpoint(lo, endpoints[0], &p_bits[0]);
+    QuantizeBC7Endpoint(hi, endpoints[1], &p_bits[1]);
+
+    float palette[16][4];
+    for (int j = 0; j < 16; j++)
+        for (int c = 0; c < 4; c++)
+            palette[j][c] = (float)(((64 - weights[j]) * endpoints[0][c] + weights[j] * endpoints[1][c] + 32) >> 6);
+
+    unsigned char indices[16];
+    NearestPaletteIndices(block, palette, 16, 4, indices);
+
+    // El bit alto del índice del píxel 0 es implícito (0): si no lo es, invertir los extremos
+    if (indices[0] & 8)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            int t = endpoints[0][c]; endpoints[0][c] = endpoints[1][c]; endpoints[1][c] = t;
+        }
+        int t = p_bits[0]; p_bits[0] = p_bits[1]; p_bits[1] = t;
+        for (int i = 0; i < 16; i++)
+            indices[i] = (unsigned char)(15 - indices[i]);
+    }
+
+    memset(out, 0, 16);
+    int position = 0;
+    WriteBits(out, &position, 1u << 6, 7); // Modo 6
+    for (int c = 0; c < 4; c++)
+    {
+        WriteBits(out, &position, (unsigned)endpoints[0][c] >> 1, 7);
+        WriteBits(out, &position, (unsigned)endpoints[1][c] >> 1, 7);
+    }
+    WriteBits(out, &position, (unsigned)p_bits[0], 1);
+    WriteBits(out, &position, (unsigned)p_bits[1], 1);
+    WriteBits(out, &position, indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        WriteBits(out, &position, indices[i], 4);
+}
+
 void ExitOnGLError(const char* message) // Función para salir en caso de error de OpenGL
 {
     GLenum error = glGetError();
@@ -142,8 +665,16 @@ void ExitOnGLError(const char* message) // Función para salir en caso de error
     }
 }
 
+// La compilación puede seguir en hilos del driver (KHR_parallel_shader_compile):
+// LoadShaderWithDefines no consulta el estado; CheckShaderCompile lo hace
+// cuando el programa está listo
 GLuint LoadShader(const char* filename, GLenum shader_type) // Función para cargar un shader desde un archivo
 {
+return LoadShaderWithDefines(filename, shader_type, NULL);
+}
+
+GLuint LoadShaderWithDefines(const char* filename, GLenum shader_type, const char* defines) // Función para cargar un shader insertando #defines tras #version
+{
 GLuint shader_id = 0;
 FILE* file;
 long file_size = -1;
@@ -163,7 +694,15 @@ if (NULL != (file = fopen(filename, "rb")) &&
 
         if (0 != (shader_id = glCreateShader(shader_type)))
         {
-        glShaderSource(shader_id, 1, &glsl_source, NULL);
+        // Partir el código tras la línea #version para insertar los defines
+        const char* version = strstr(glsl_source, "#version");
+        const char* body = version ? strchr(version, '\n') : NULL;
+        body = body ? body + 1 : glsl_source;
+
+        const GLchar* sources[3] = { glsl_source, defines ? defines : "", body };
+        GLint lengths[3] = { (GLint)(body - glsl_source), -1, -1 };
+
+        glShaderSource(shader_id, 3, sources, lengths);
         glCompileShader(shader_id);
         ExitOnGLError("Could not compile a shader");
         }
@@ -176,7 +715,7 @@ if (NULL != (file = fopen(filename, "rb")) &&
     free(glsl_source);
     }
     else
-    fprintf(stderr, "ERROR: Could not allocate %i bytes.\n", file_size);
+    fprintf(stderr, "ERROR: Could not allocate %li bytes.\n", file_size);
 
     fclose(file);
 }
@@ -190,4 +729,36 @@ else
 return shader_id;
 }
 
+int CheckShaderCompile(GLuint shader, const char* name) // Función para comprobar GL_COMPILE_STATUS e imprimir el log completo
+{
+GLint status = GL_FALSE, length = 0;
+glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+if (status)
+    return 1;
+
+glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+char* log = (char*)malloc(length > 1 ? length : 1);
+log[0] = '\0';
+if (length > 1)
+    glGetShaderInfoLog(shader, length, NULL, log);
+fprintf(stderr, "ERROR: %s failed to compile:\n%s\n", name, log);
+free(log);
+return 0;
+}
 
+int CheckProgramLink(GLuint program, const char* name) // Función para comprobar GL_LINK_STATUS e imprimir el log completo
+{
+GLint status = GL_FALSE, length = 0;
+glGetProgramiv(program, GL_LINK_STATUS, &status);
+if (status)
+    return 1;
+
+glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+char* log = (char*)malloc(length > 1 ? length : 1);
+log[0] = '\0';
+if (length > 1)
+    glGetProgramInfoLog(program, length, NULL, log);
+fprintf(stderr, "ERROR: %s shader link failed:\n%s\n", name, log);
+free(log);
+return 0;
+}
@@ -27,7 +27,7 @@ float Cotangent(float angle); // Función para calcular la cotangente de un áng
 float DegreesToRadians(float degrees); // Función para convertir grados a radianes
 float RadiansToDegrees(float radians); // Función para convertir radianes a grados
 
-Matrix MultiplyMatrices(const Matrix* m1, const Matrix* m2); // Función para multiplicar dos matrices
+Matrix MultiplyMatrices(const Matrix* m1, const Matrix* m2); // Función para multiplicar dos matrices (el resultado aplica m1 y después m2)
 void RotateAboutxAxis(Matrix* m, float angle); // Función para rotar una matriz alrededor del eje x
 void RotateAboutyAxis(Matrix* m, float angle); // Función para rotar una matriz alrededor del eje y
 void RotateAboutzAxis(Matrix* m, float angle); // Función para rotar una matriz alrededor del eje z
@@ -35,10 +35,31 @@ void ScaleMatrix(Matrix* m, float x, float y, float z); // Función para escalar
 void TranslateMatrix(Matrix* m, float x, float y, float z); // Función para trasladar una matriz
 
 Matrix CreateProjectionMatrix(float fovY, float aspect, float nearPlane, float farPlane); // Función para crear una matriz de proyección
+Matrix CreateOrthographicMatrix(float left, float right, float bottom, float top, float nearPlane, float farPlane); // Función para crear una matriz de proyección ortográfica
+Matrix CreateLookAtMatrix(const float eye[3], const float center[3], const float up[3]); // Función para crear una matriz de vista
+Matrix InvertMatrix(const Matrix* m); // Función para invertir una matriz 4x4
+void TransformPoint(const Matrix* m, const float in[3], float out[3]); // Función para transformar un punto por una matriz
+void TransformDirection(const Matrix* m, const float in[3], float out[3]); // Función para transformar una dirección (sin traslación)
+void TransformAABB(const Matrix* m, const float inMin[3], const float inMax[3], float outMin[3], float outMax[3]); // Función para transformar una caja alineada
+void ExtractFrustumPlanes(const Matrix* viewProjection, float planes[6][4]); // Función para extraer los planos de un frustum
+int AABBIntersectsFrustum(const float planes[6][4], const float boxMin[3], const float boxMax[3]); // Función para probar una caja contra un frustum
+int SphereIntersectsAABB(const float center[3], float radius, const float boxMin[3], const float boxMax[3]); // Función para probar una esfera contra una caja
+int RayIntersectsTriangle(const float origin[3], const float dir[3], const float v0[3], const float e1[3], const float e2[3], float maxT); // Función para probar un rayo contra un triángulo
+
+#define HASH_BYTES_SEED 14695981039346656037ULL // Valor inicial de HashBytes (FNV-1a de 64 bits)
+unsigned long long HashBytes(const void* data, size_t size, unsigned long long hash); // Función para acumular bytes en un hash FNV-1a
+
+void DownsampleRGBA(const unsigned char* src, int width, int height, unsigned char* dst); // Función para reducir una imagen RGBA8 a la mitad (caja 2x2)
+void ExtractBlockRGBA(const unsigned char* image, int width, int height, int blockX, int blockY, unsigned char block[64]); // Función para copiar un bloque de 4x4 píxeles
+void EncodeBC1Block(const unsigned char block[64], unsigned char out[8]); // Función para comprimir un bloque opaco a BC1
+void EncodeBC7Block(const unsigned char block[64], unsigned char out[16]); // Función para comprimir un bloque RGBA a BC7 (modo 6)
 
 void ExitOnGLError(const char* message); // Función para salir en caso de error de OpenGL
 
 GLuint LoadShader(const char* filename, GLenum shader_Type); // Función para cargar un shader desde un archivo
+GLuint LoadShaderWithDefines(const char* filename, GLenum shader_Type, const char* defines); // Igual que LoadShader, insertando defines tras #version
+int CheckShaderCompile(GLuint shader, const char* name); // Función para comprobar GL_COMPILE_STATUS e imprimir el log completo
+int CheckProgramLink(GLuint program, const char* name); // Función para comprobar GL_LINK_STATUS e imprimir el log completo
 
 
 #endif // UTILS_H
\ No newline at end of file
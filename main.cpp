@@ -6,6 +6,26 @@
 #include <iostream> // Para std::cout, std::endl
 #include <algorithm> // Para std::count
 #include <map> // Para std::map
+#include <chrono> // Para std::chrono::steady_clock
+#include <thread> // Para std::this_thread::sleep_for
+#include <atomic> // Para std::atomic (buffers de trazas)
+#include <mutex> // Para std::mutex (registro de hilos de trazas)
+#include <condition_variable> // Para std::condition_variable (job system)
+#include <functional> // Para std::function (trabajos de ParallelFor)
+#include <deque> // Para std::deque (cola FIFO de TaskQueue)
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h> // Para SSE (cuatro cajas del BVH del horneado por instrucción)
+#define BAKE_SIMD 1
+#endif
+
+#ifdef _WIN32
+#include <mmsystem.h> // Para timeBeginPeriod (resolución de Sleep)
+#include <direct.h> // Para _mkdir (directorio de la caché de programas)
+#else
+#include <GL/glx.h> // Para glXGetProcAddressARB (intervalo de swap)
+#include <sys/stat.h> // Para mkdir (directorio de la caché de programas)
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h" // Para carga de imágenes
@@ -14,6 +34,8 @@
 
 int CurrentWidth = 800;  // Ancho actual de la ventana
 int CurrentHeight = 600; // Alto actual de la ventana
+int RenderWidth = 800;   // Resolución interna de los pases de pantalla (ventana * RenderScale)
+int RenderHeight = 600;
 int WindowHandle = 0; // Manejador de la ventana GLUT
 
 size_t IndexCount = 0; // Número de índices para el objeto principal
@@ -22,7 +44,36 @@ size_t GroundIndexCount = 0; // Número de índices para el suelo
 unsigned FrameCount = 0; // Contador de frames renderizados
 unsigned TotalFrameCount = 0; // Contador total de frames
 float FPS = 0.0f; // FPS actuales
-clock_t FPSLastTime = 0; // Tiempo del último cálculo de FPS
+
+typedef std::chrono::steady_clock FrameClock; // Reloj de pared monotónico
+FrameClock::time_point FPSLastTime; // Tiempo del último cálculo de FPS
+FrameClock::time_point LastFrameTime; // Inicio del frame anterior
+FrameClock::time_point NextFrameTime; // Inicio programado del siguiente frame (modo CAP)
+float FrameDeltaSeconds = 0.0f; // Tiempo real transcurrido desde el frame anterior
+
+enum FramePacingMode { PACING_VSYNC, PACING_CAPPED, PACING_UNCAPPED }; // Modos del planificador de frames
+FramePacingMode PacingMode = PACING_CAPPED; // Modo actual
+float FrameCapFPS = 60.0f; // Límite de FPS en modo CAP
+const float FRAME_SPIN_MARGIN_MS = 1.5f; // Margen final que se espera activamente en vez de dormir
+const float FRAME_MAX_SLEEP_MS = 4.0f;   // Sueño máximo por llamada de idle (mantiene la entrada ágil)
+float FrameTimeMs[2] = {0.0f, 0.0f}; // Tiempo medio de frame sin / con pre-pase de profundidad
+float ShadingFrameMs[2] = {0.0f, 0.0f}; // Tiempo medio de frame en modo forward / diferido
+
+// Reposo: sin animación ni cambios no se vuelve a renderizar. Tras IDLE_SETTLE_FRAMES
+// frames iguales se copia el último frame presentado, se quita la función de idle y
+// GLUT queda bloqueado esperando eventos. Una exposición vuelve a presentar la copia;
+// una tecla o un resize despiertan el bucle
+bool IdleSkipping = true;              // I: permitir el reposo (--no-idle-skip lo desactiva)
+const int IDLE_SETTLE_FRAMES = 32;     // Frames sin cambios antes de reposar (acumulación temporal, queries)
+int IdleSettleFrames = IDLE_SETTLE_FRAMES; // Frames sin cambios que faltan
+bool SceneIdle = false;                // En reposo: sin función de idle, solo se re-presenta
+bool TimerArmed = false;               // Hay un glutTimerFunc pendiente (no se re-arma en reposo)
+bool IdleFullResolution = false;       // Escala 1 forzada para el frame de reposo (controlador en pausa)
+unsigned long long IdleSceneKey = 0;   // Transformaciones, cámara, luz y ventana del frame anterior
+unsigned IdleSleeps = 0;               // Veces que se entró en reposo
+unsigned IdlePresents = 0;             // Exposiciones servidas desde la copia
+GLuint PresentCacheFBO = 0, PresentCacheRB = 0; // Copia del último frame presentado
+int PresentCacheWidth = 0, PresentCacheHeight = 0;
 
 GLuint
 ProjectionMatrixUniformLocation, // Ubicación uniforme de la matriz de proyección
@@ -35,33 +86,695 @@ MaterialColorUniformLocation, // Ubicación uniforme del color del material
 ViewPosUniformLocation; // Ubicación uniforme de la posición de la cámara
 
 GLuint BufferIds[3] = {0}; // VAO, VBO, IBO para el objeto principal
-GLuint ShaderIds[3] = {0}; // IDs de shaders (vertex, fragment, program)    
+GLuint ShaderIds[3] = {0}; // IDs de shaders (program de la variante activa, -, vertex compartido)
+
+const int SHADOW_QUALITY_COUNT = 5; // Variantes del filtro de sombras (SHADOW_QUALITY en el shader)
+const int SHADOW_QUALITY_PCF9 = 2;  // Referencia para comparar con EVSM
+const int SHADOW_QUALITY_EVSM = 4;  // Momentos exponenciales desenfocados (una lectura filtrada)
+const char* ShadowQualityNames[SHADOW_QUALITY_COUNT] = { "1-tap", "Gather 3x3", "9-tap", "Poisson 16", "EVSM" };
+float ShadowFilterFrameMs[SHADOW_QUALITY_COUNT] = {0}; // Tiempo medio de frame medido con cada variante
+int ShadowQuality = 1; // Variante activa (por defecto gather: 3x3 con 4 lecturas)
+
+// Permutaciones del programa principal: cada combinación de características se
+// compila como un programa especializado (defines tras #version) y se guarda
+// en caché por su clave. Bits 0–7 = características, 8–10 = SHADOW_QUALITY,
+// 12–18 = focos, 20–23 = luces puntuales
+enum ShaderFeature
+{
+    SHADER_TEXTURED    = 1 << 0, // Color base de la textura (TEXTURED)
+    SHADER_SHADOW_MASK = 1 << 1, // Sombra del sol desde la máscara de pantalla (SHADOW_MASK)
+    SHADER_CLUSTERED   = 1 << 2, // Luces sin sombra de la rejilla (CLUSTERED)
+    SHADER_DEFERRED    = 1 << 3, // Iluminación a pantalla completa desde el G-buffer (DEFERRED_LIGHTING)
+    SHADER_GBUFFER     = 1 << 4, // Pase de geometría diferido (GBuffer.fragment)
+    SHADER_LIGHTMAP    = 1 << 5  // Sol horneado en el lightmap, sin cascadas (LIGHTMAPPED)
+};
+const int SHADER_QUALITY_SHIFT = 8;
+const int SHADER_SPOT_SHIFT = 12;
+const int SHADER_POINT_SHIFT = 20;
+const float MATERIAL_SHININESS = 32.0f; // SHININESS en el shader
+const float DISPLAY_GAMMA = 2.2f;       // GAMMA en el shader
+const int PCF_KERNEL_RADIUS = 1;        // PCF_RADIUS del filtro 9-tap (1 = 3x3)
+std::map<unsigned, GLuint> MainProgramCache; // Clave de variante -> programa enlazado
+std::map<unsigned, GLuint> MainProgramFallback; // Última variante lista por tipo de pase (mientras compila la nueva)
+
+// Caché en disco de programas enlazados (glGetProgramBinary / glProgramBinary).
+// Cada archivo se nombra por el hash de las fuentes, los defines, el driver y
+// los formatos binarios que acepta; un binario rechazado se borra y se recompila
+struct ShaderStageSource
+{
+    GLenum type;
+    const char* file;
+    const char* defines; // NULL = sin defines
+    GLuint* shared;      // Objeto compartido entre programas (se compila al primer fallo), o NULL
+};
+bool ProgramCacheEnabled = true;        // --no-shader-cache: compilar siempre (arranque en frío)
+const char* PROGRAM_CACHE_DIR = "shader_cache";
+const unsigned PROGRAM_CACHE_MAGIC = 0x4E494250; // "PBIN"
+std::string ProgramCacheDriverKey;      // GL_RENDERER + GL_VERSION + formatos binarios
+unsigned ProgramCacheHits = 0;          // Programas cargados desde disco
+unsigned ProgramCacheMisses = 0;        // Programas compilados y enlazados
+unsigned ProgramCacheEvictions = 0;     // Binarios rechazados por el driver y borrados
+float ProgramBuildMs = 0.0f;            // Tiempo total creando programas (disco o compilación)
+FrameClock::time_point StartupTime;     // Inicio de main (tiempo de arranque)
+
+// Servicio de compilación: programas pedidos que aún no están enlazados
+struct PendingStage
+{
+    GLenum type;
+    std::string file;
+    std::string defines;
+    GLuint* shared;
+};
+struct PendingProgram
+{
+    GLuint program;
+    std::string name;
+    std::string path;                   // Archivo de la caché donde guardar el binario
+    std::vector<PendingStage> stages;
+    std::vector<GLuint> shaders;         // Objetos adjuntos (para leer su estado al terminar)
+    std::function<void(GLuint)> onReady; // Unidades de textura y ubicaciones una vez enlazado
+    FrameClock::time_point submitted;
+    bool started;                        // Compilación y enlace ya pedidos al driver
+};
+std::vector<PendingProgram> PendingPrograms;
+bool ParallelShaderCompile = false;     // KHR/ARB_parallel_shader_compile disponible
+const float SHADER_COMPILE_BUDGET_MS = 8.0f; // Sin extensión: tiempo de compilación por frame
+bool StartupProgramsReady = false;      // Ya se dibujó un frame; hasta entonces solo se limpia la pantalla
+std::vector<GLuint> StartupPrograms;    // Los que dibuja el primer frame (sin extensión se construyen antes)
+bool ProgramsSummaryPrinted = false;    // Cola de arranque vacía y resumen impreso
+unsigned ShaderCompileErrors = 0;       // Programas con errores de compilación o enlace
 
 GLuint GroundVAO = 0, GroundVBO = 0, GroundIBO = 0; // VAO, VBO, IBO para el suelo
 
 GLuint BaseColorTex = 0, NormalTex = 0, RoughnessTex = 0, AOTex = 0; // Texturas del modelo
 
-// Después de las texturas (línea ~38), añadir:
 GLuint ShadowFBO = 0;           // Framebuffer para sombras
-GLuint ShadowMap = 0;           // Textura de profundidad para sombras
-const int SHADOW_WIDTH = 2048;  // Resolución del mapa de sombras
-const int SHADOW_HEIGHT = 2048;
+GLuint ShadowMap = 0;           // Array de texturas de profundidad (una capa por cascada)
+const int MAX_SHADOW_CASCADES = 4; // Capas reservadas en el array
+
+int ShadowMapSize = 0;          // Resolución actual de cada cascada (se elige en tiempo de ejecución)
+GLenum ShadowMapFormat = GL_DEPTH_COMPONENT24; // Formato de profundidad actual
+const int SHADOW_SIZE_MIN = 256;  // Límites del tamaño adaptativo (potencias de dos)
+const int SHADOW_SIZE_MAX = 2048;
+int ShadowFixedSize = 0;          // --shadow-size N fija la resolución (0 = adaptativa)
+float ShadowMemoryBudgetMB = 128.0f;   // Memoria máxima de mapa + capa estática (+ momentos EVSM)
+float ShadowTexelsPerPixel = 1.0f;     // Densidad objetivo: texels de sombra por píxel de pantalla
+float ShadowDepthTexelFraction = 0.125f; // Bias constante de D16 aceptable, como fracción del lado de un texel
+const int SHADOW_SHRINK_FRAMES = 60;   // Frames pidiendo menos antes de reducir (evita realocar en cada frame)
+int ShadowShrinkFrames = 0;
+float CascadeExtents[MAX_SHADOW_CASCADES];     // Lado del área cubierta por cada cascada (unidades de mundo)
+float CascadeDepthRanges[MAX_SHADOW_CASCADES]; // Distancia entre planos cercano y lejano de cada cascada
+float CascadeSliceDepths[MAX_SHADOW_CASCADES]; // Profundidad de vista media de cada corte
+
+int ShadowCascadeCount = 3;     // Cascadas activas (1..MAX_SHADOW_CASCADES)
+float ShadowDistance = 30.0f;   // Distancia de vista cubierta por las cascadas
+float CascadeSplitLambda = 0.75f; // Mezcla logarítmica/uniforme del esquema práctico
+float ShadowExtentQuantum = 0.5f; // Paso al que se redondea el tamaño de cada cascada (evita temblor)
+float ShadowDepthQuantum = 0.5f;  // Paso al que se redondean los planos cercano/lejano de la luz
+Matrix CascadeMatrices[MAX_SHADOW_CASCADES]; // Proyección * vista de la luz por cascada
+float CascadeSplits[MAX_SHADOW_CASCADES];    // Profundidad de vista donde termina cada cascada
+
+float ShadowSlopeBias = 2.0f;    // glPolygonOffset: factor por pendiente en el pase de sombras
+float ShadowConstantBias = 4.0f; // glPolygonOffset: unidades constantes
+float LightDirection[3] = { 0.3f, 1.0f, 0.5f }; // Dirección hacia la luz (sin normalizar)
+
+GLuint ShadowMoments = 0;          // Array RGBA32F de momentos EVSM por cascada (con mipmaps)
+GLuint ShadowMomentsTemp = 0;      // Resultado intermedio del desenfoque horizontal
+int ShadowMomentsSize = 0;         // Resolución de los momentos (se reservan al usar EVSM)
+GLuint ShadowDepthSampler = 0;     // Sampler sin comparación para leer la profundidad en el compute
+GLuint ShadowBlurPrograms[2] = {0}; // Compute: profundidad -> momentos + blur X, blur Y
+float EvsmExponents[2] = { 40.0f, 5.0f }; // Exponentes positivo / negativo (límite de 32F: ~42)
+float EvsmBleedReduction = 0.3f;   // Recorte de la cola de Chebyshev contra light bleeding (0..1)
+float EvsmVarianceBias = 0.01f;    // Varianza mínima relativa (evita acné en superficies planas)
+int EvsmBlurRadius = 2;            // Radio del desenfoque separable (caja de 2r+1)
+bool ShadowMomentsValid = false;   // Los momentos corresponden al mapa de profundidad actual
+
+const int MAX_SPOT_LIGHTS = 64;      // Debe coincidir con MAX_SPOT_LIGHTS en los shaders
+const int SPOT_ATLAS_SIZE = 4096;    // Atlas de profundidad compartido por todos los focos
+const int SPOT_TILE_MAX = 1024;      // Resolución de tile para un foco cercano a la cámara
+const int SPOT_TILE_MIN = 128;
+const int SPOT_BATCH_MAX = 16;       // Focos por draw instanciado (limitado por GL_MAX_VIEWPORTS)
+
+struct ShadowUpdateState // Estado de planificación del mapa de sombras de una luz local
+{
+    bool valid;           // El mapa se ha renderizado desde la última reasignación
+    bool dirty;           // Algún proyector de su zona se movió desde la última actualización
+    bool scheduled;       // Elegida para actualizarse este frame
+    unsigned updatedFrame; // Frame de la última actualización
+    unsigned cost;        // Triángulos estimados de una actualización
+};
+
+struct SpotLight // Foco con sombra en el atlas
+{
+    float position[3];
+    float target[3];
+    float color[3];
+    float range;        // Alcance (plano lejano de su proyección)
+    float outerAngle;   // Semiángulo del cono en grados
+    float innerAngle;   // Semiángulo sin atenuación
+    int resolution;     // Lado del tile en el atlas
+    int atlasX, atlasY; // Esquina del tile en el atlas
+    Matrix matrix;      // Proyección * vista del foco
+    ShadowUpdateState shadow;
+};
+
+struct SpotLightGPU // Mismo layout que SpotLightData (std140) en los shaders
+{
+    float matrix[16];
+    float positionRange[4]; // xyz posición, w alcance
+    float directionCos[4];  // xyz dirección, w coseno del ángulo exterior
+    float color[4];         // rgb color, w coseno del ángulo interior
+    float atlasRect[4];     // xy origen, zw tamaño (coordenadas de textura del atlas)
+};
+
+std::vector<SpotLight> SpotLights;   // Focos activos
+int SpotLightCount = 0;              // Focos pedidos (tecla L: 0, 4, 16, 64); desactivados por defecto
+GLuint SpotLightUBO = 0;             // Datos de los focos (binding 0)
+GLuint SpotShadowAtlas = 0;          // Profundidad de todos los focos, un tile por foco
+GLuint SpotShadowFBO = 0;
+GLuint SpotShadowProgram = 0;        // Vertex shader instanciado (un foco por instancia)
+GLint SpotBatchSlotsLoc = -1, SpotSlotLightsLoc = -1, SpotModelLoc = -1;
+bool SpotViewportArray = false;      // gl_ViewportIndex desde el vertex shader (ARB_shader_viewport_layer_array)
+int SpotBatchSize = 1;               // Focos por draw instanciado
+unsigned SpotShadowDraws = 0;        // Draws emitidos en la última actualización del atlas
+unsigned SpotShadowInstances = 0;    // Tiles rellenados (instancias) en la última actualización
+
+const int MAX_POINT_LIGHTS = 8;      // Debe coincidir con MAX_POINT_LIGHTS en SimpleShader.fragment.glsl
+const int POINT_SHADOW_SIZE = 512;   // Lado de cada cara del cubo
+const float POINT_SHADOW_NEAR = 0.1f; // Plano cercano de las caras (el lejano es el alcance)
+
+struct PointLight // Luz puntual con sombra en un cubo del cube map array
+{
+    float position[3];
+    float color[3];
+    float range;            // Alcance (plano lejano de las seis caras)
+    Matrix faceMatrices[6]; // Proyección * vista de cada cara
+    ShadowUpdateState shadow;
+};
+
+std::vector<PointLight> PointLights;  // Luces puntuales activas (farolas)
+int PointLightCount = 0;              // Luces pedidas (tecla T: 0, 2, 4, 8); desactivadas por defecto
+float PointLightPositionRange[MAX_POINT_LIGHTS * 4]; // xyz posición, w alcance (uniform)
+float PointLightColors[MAX_POINT_LIGHTS * 3];
+GLuint PointShadowMaps = 0;           // Cube map array de profundidad, seis capas por luz
+GLuint PointShadowFBO = 0;
+GLuint PointShadowProgram = 0;        // Vertex shader instanciado (una cara por instancia)
+GLint PointFacesLoc = -1, PointFaceMatricesLoc = -1, PointLayerLoc = -1, PointModelLoc = -1;
+bool PointVertexLayer = false;        // gl_Layer desde el vertex shader (ARB_shader_viewport_layer_array)
+unsigned PointShadowDraws = 0;        // Draws emitidos en la última actualización
+unsigned PointShadowFaces = 0;        // Caras rellenadas (instancias) en la última actualización
+
+const unsigned SHADOW_UPDATE_BUDGETS[] = { 0, 50000, 150000, 500000 }; // Presupuestos de la tecla N (0 = sin límite)
+const float SHADOW_UPDATE_AGE_FRAMES = 30.0f; // Frames de espera que duplican la prioridad de una luz
+unsigned ShadowUpdateBudget = 150000; // Triángulos por frame para sombras de focos y luces puntuales
+unsigned ShadowUpdatesDone = 0;       // Luces actualizadas en el último frame
+unsigned ShadowUpdatesSkipped = 0;    // Luces pendientes que no cupieron en el presupuesto
+unsigned ShadowUpdateTriangles = 0;   // Triángulos estimados de las actualizaciones del último frame
+unsigned ShadowUpdateMaxAge = 0;      // Frames que lleva esperando la sombra pendiente más antigua
+
+const int CLUSTER_X = 16;            // Tiles horizontales de la rejilla de clusters
+const int CLUSTER_Y = 9;             // Tiles verticales
+const int CLUSTER_Z = 24;            // Cortes de profundidad (exponenciales)
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+const float CLUSTER_FAR = 100.0f;    // Profundidad del último corte (más allá se usa el último)
+const int MAX_CLUSTER_LIGHTS = 4096; // Luces sin sombra para el camino clustered (tecla M)
+
+struct ClusterLight // Luz sin sombra asignada a clusters (puntual o foco)
+{
+    float basePosition[3]; // Posición en reposo (la altura oscila)
+    float position[3];
+    float range;
+    float color[3];
+    float direction[3];    // Solo focos
+    float cosOuter;        // Coseno del ángulo exterior (-2 = luz puntual)
+    float cosInner;
+    float phase;           // Fase de la oscilación
+};
+
+struct ClusterLightGPU // Mismo layout que ClusterLightData (std430) en el shader
+{
+    float positionRange[4]; // xyz posición, w alcance
+    float color[4];         // rgb color, w coseno del ángulo interior
+    float directionCos[4];  // xyz dirección, w coseno del ángulo exterior (-2 = puntual)
+};
+
+struct ClusterLightBounds // Rango de clusters que toca una luz (inclusivo)
+{
+    unsigned char x0, x1, y0, y1, z0, z1;
+    bool visible;
+};
+
+std::vector<ClusterLight> ClusterLights;       // Luces del camino clustered
+int ClusterLightCount = 0;                     // Luces pedidas (tecla M: 0, 256, 1024, 4096); desactivadas por defecto
+std::vector<ClusterLightGPU> ClusterLightData; // Copia para el SSBO (se rellena en paralelo)
+std::vector<ClusterLightBounds> ClusterBounds; // Clusters de cada luz este frame
+std::vector<unsigned> ClusterSliceIndices[CLUSTER_Z]; // Índices de luces de cada corte de profundidad
+std::vector<unsigned> ClusterRanges;           // (offset, cantidad) por cluster
+std::vector<unsigned> ClusterIndices;          // Índices de luces de todos los clusters
+GLuint ClusterLightSSBO = 0;                   // binding 1: luces
+GLuint ClusterRangeSSBO = 0;                   // binding 2: rango de cada cluster
+GLuint ClusterIndexSSBO = 0;                   // binding 3: lista de índices
+unsigned ClusterReferences = 0;                // Total de pares luz-cluster del último frame
+unsigned ClusterMaxLights = 0;                 // Máximo de luces en un cluster
+float ClusterBuildMs = 0.0f;                   // Tiempo de CPU de la asignación (todos los hilos)
+bool ClusterEmptyUploaded = false;             // Los SSBOs ya tienen listas vacías (sin luces no hay que reconstruir)
+bool ClusterAnimate = true;                    // Balanceo de las luces clustered (tecla Y); quietas no impiden el reposo
+float ClusterAnimationTime = 0.0f;             // Tiempo de animación acumulado (se congela en pausa)
+
+const float CAMERA_POSITION[3] = { 0.0f, 1.8f, 7.5f }; // Posición fija del ojo (ViewMatrix la traslada al origen)
+const float CAMERA_FOV = 60.0f;   // Campo de visión vertical
+const float CAMERA_NEAR = 0.1f;   // Plano cercano de la cámara
+const float CAMERA_FAR = 200.0f;  // Plano lejano de la cámara
 
 GLuint ShadowShaderIds[3] = {0}; // Shader separado para generar sombras
-Matrix LightProjectionMatrix;   // Matriz de proyección desde la luz
+GLuint DepthPrePassProgram = 0;  // Programa solo-posición para el pre-pase de profundidad
+GLint DepthPrePassModelLoc = -1, DepthPrePassViewLoc = -1, DepthPrePassProjectionLoc = -1; // Uniforms del pre-pase
+bool DepthPrePass = false;       // Flag para pre-pase de profundidad (early-Z)
+
+bool ScreenSpaceShadows = false;    // Resolver la sombra del sol en una máscara de pantalla (tecla S)
+GLuint ScreenDepthTex[2] = {0};     // Profundidad de pantalla del frame actual / anterior
+GLuint ScreenDepthFBO[2] = {0};
+GLuint ShadowMaskTex[2] = {0};      // Máscara R8 acumulada (ping-pong con la del frame anterior)
+GLuint ShadowMaskFBO[2] = {0};
+int ScreenTargetsWidth = 0, ScreenTargetsHeight = 0; // Tamaño con el que se crearon
+int ShadowMaskIndex = 0;            // Máscara/profundidad escritas en el frame actual
+bool ShadowMaskHistoryValid = false; // La máscara anterior se puede reproyectar
+float ShadowMaskBlend = 0.1f;       // Peso del frame actual en la acumulación temporal
+Matrix PrevViewProjection;          // Vista-proyección del frame anterior (reproyección)
+GLuint ShadowMaskProgram = 0;       // Pantalla completa: profundidad -> máscara
+
+bool DeferredShading = false;       // Pase de geometría + iluminación a pantalla completa (tecla X)
+GLuint GBufferFBO = 0;
+GLuint GBufferAlbedo = 0;           // RGBA8: raíz cuadrada del albedo
+GLuint GBufferNormal = 0;           // RG16: normal octaédrica
+GLuint GBufferDepth = 0;            // DEPTH24: se reconstruye la posición
+int GBufferWidth = 0, GBufferHeight = 0; // Tamaño con el que se creó
+
+float GBufferMemoryMB(int width, int height) // Albedo 4 + normal 4 + profundidad 4 bytes por píxel
+{
+    return width * height * (4.0f + 4.0f + 4.0f) / (1024.0f * 1024.0f);
+}
+GLuint FullscreenVAO = 0;           // VAO vacío para el triángulo de pantalla completa
+
+// Resolución dinámica: el pase principal (y los objetivos de pantalla: máscara,
+// G-buffer, clusters) se renderiza a una fracción de la ventana que elige un
+// controlador con el tiempo de GPU medido, y se escala a la ventana con un blit
+// bilineal. La escala se cuantiza en clases de tamaño para que los objetivos
+// solo se realojen al cambiar de clase; a escala 1 se dibuja directamente
+bool DynamicResolution = true;            // H: activar el controlador (desactivado = escala 1)
+float GpuBudgetMs = 0.0f;                 // --gpu-budget MS (0 = 85% del periodo del CAP)
+const float RENDER_SCALE_MIN = 0.5f;      // Escala de la clase más baja
+const int RENDER_SCALE_CLASSES = 6;       // 50%, 60%, ..., 100%
+const int RENDER_SCALE_UP_SAMPLES = 30;   // Muestras seguidas con margen antes de subir una clase
+const int RENDER_SCALE_COOLDOWN = 8;      // Muestras ignoradas tras un cambio (latencia de las queries)
+const float RENDER_SCALE_UP_MARGIN = 1.05f; // La clase superior debe caber con este margen
+int RenderScaleClass = RENDER_SCALE_CLASSES - 1; // Clase actual
+float RenderScaleWanted = 1.0f;           // Salida continua del controlador (para el título)
+float GpuFrameMsSmoothed = 0.0f;          // Tiempo de GPU del frame filtrado
+unsigned RenderScaleSamples = 0;          // Muestras de GPU ya consumidas por el controlador
+int RenderScaleCooldown = 0;
+int RenderScaleUpSamples = 0;
+unsigned RenderScaleChanges = 0;          // Cambios de clase (realojos de objetivos)
+GLuint SceneFBO = 0;                      // Objetivo del pase principal por debajo de escala 1
+GLuint SceneColorRB = 0, SceneDepthRB = 0;
+int SceneTargetWidth = 0, SceneTargetHeight = 0;
+
+float RenderScaleForClass(int sizeClass) // Escala de una clase de tamaño
+{
+    return RENDER_SCALE_MIN + (1.0f - RENDER_SCALE_MIN) * sizeClass / (RENDER_SCALE_CLASSES - 1);
+}
 Matrix LightViewMatrix;          // Matriz de vista desde la luz
 
 Matrix ProjectionMatrix; // Matriz de proyección
 Matrix ViewMatrix; // Matriz de vista
 Matrix ModelMatrix; // Matriz de modelo
+Matrix ObjectModelMatrix; // Matriz de modelo del objeto principal para el frame actual
 
 float CubeRotationAngle = 0; // Ángulo de rotación del objeto principal   
-clock_t LastTime = 0; // Tiempo del último frame
 
 float ObjectPositionX = 0.0f; // Posición X del objeto
 float ManualRotationAngle = 0.0f; // Ángulo de rotación manual
 bool AutoRotate = true; // Flag para rotación automática
 
+struct SceneObject // Objeto de la escena para los pases de sombra y pre-pase
+{
+    const char* name;
+    GLuint vao;
+    size_t indexCount;
+    Matrix modelMatrix;
+    bool isStatic;       // Nunca se mueve: se dibuja en la capa estática de sombras
+    bool castsShadows;   // Se dibuja en el shadow map (el suelo solo recibe)
+    bool transformDirty; // Su transformación cambió desde el último pase de sombras
+    float localMin[3], localMax[3]; // AABB en espacio de objeto
+    float worldMin[3], worldMax[3]; // AABB en espacio mundial (se actualiza con la transformación)
+    float prevWorldMin[3], prevWorldMax[3]; // AABB mundial antes del último cambio de transformación
+    float lightMin[3], lightMax[3]; // AABB en espacio de la luz (UpdateShadowCascades, cada frame)
+    unsigned shadowCascadeMask;     // Cascadas en las que el proyector sobrevive al culling
+    const std::vector<Vertex>* bakeVertices; // Malla en CPU para el horneado del lightmap (NULL = no participa)
+    const std::vector<GLuint>* bakeIndices;
+    unsigned long long bakeHash;    // Hash de la malla (parte de la clave del lightmap)
+    bool lightmapped;               // Receptor estático con lightmap (UV únicas en [0, 1])
+};
+
+std::vector<SceneObject> SceneObjects; // Todos los objetos dibujables
+int HouseObjectIndex = -1;  // Índice del modelo OBJ en SceneObjects
+int GroundObjectIndex = -1; // Índice del suelo en SceneObjects
+
+enum ShadowUpdateKind { SHADOW_UPDATE_CACHED, SHADOW_UPDATE_DYNAMIC, SHADOW_UPDATE_FULL }; // Trabajo hecho por el último pase de sombras
+bool ShadowCaching = true;     // Reutilizar el shadow map si nada cambió
+bool ShadowCacheValid = false; // El contenido del shadow map corresponde a ShadowCachedCascades
+Matrix ShadowCachedCascades[MAX_SHADOW_CASCADES]; // Matrices de luz con las que se generó el mapa
+int ShadowCachedCascadeCount = 0;
+ShadowUpdateKind LastShadowUpdate = SHADOW_UPDATE_FULL;
+
+bool ShadowCasterCulling = true;  // Descartar proyectores que no pueden aportar sombra visible
+float ShadowReceiverMinZ = 0.0f;  // Z más lejana (espacio de luz) de los receptores visibles
+unsigned ShadowCastersDrawn = 0;  // Draws de proyectores en la última actualización del mapa
+unsigned ShadowCastersCulled = 0; // Draws evitados por el culling en la última actualización
+GLuint ShadowStaticFBO = 0;  // Framebuffer de la capa estática
+GLuint ShadowStaticMap = 0;  // Profundidad de proyectores estáticos (se copia al mapa cada actualización)
+
+// Lightmap horneado en CPU para los receptores estáticos (el suelo): luz directa
+// del sol con penumbra, trazando rayos contra los proyectores. El mapa vale
+// mientras ningún proyector se mueva; en cuanto uno se mueve el receptor vuelve
+// a las cascadas en tiempo real y, cuando la escena se queda quieta, se hornea
+// de nuevo en trozos por frame (o se lee del disco si ese estado ya se horneó)
+struct BakeTriangle
+{
+    float v0[3], e1[3], e2[3]; // Vértice y aristas en espacio mundial (Möller–Trumbore)
+};
+
+struct BakeBVHNode // Nodo de cuatro hijos con las cajas en SoA (se prueban las cuatro a la vez)
+{
+    float boundsMin[3][4], boundsMax[3][4];
+    int child[4];  // Nodo hijo, primer triángulo de la hoja, o -1 = hueco vacío
+    int count[4];  // Triángulos de la hoja (0 = nodo interno)
+};
+
+struct LightmapTexel // Texel cubierto por un receptor
+{
+    float position[3], normal[3]; // Espacio mundial
+    unsigned index;               // Posición en el lightmap
+};
+
+struct LightmapBake // Horneado en curso
+{
+    unsigned long long key;               // Estado de la escena que se hornea (0 = ninguno)
+    std::vector<BakeTriangle> triangles;  // Ordenados por hoja del BVH
+    std::vector<BakeBVHNode> nodes;       // nodes[0] = raíz (vacío = sin proyectores)
+    std::vector<LightmapTexel> texels;
+    std::vector<unsigned char> data;      // RG8: r = N·L * visibilidad, g = visibilidad del sol
+    unsigned nextTexel;                   // Siguiente texel por hornear
+    float ms;                             // Tiempo de CPU acumulado
+    std::atomic<unsigned long long> rays; // Rayos de sombra trazados
+};
+
+bool LightmapEnabled = true;                 // J: hornear y usar el lightmap
+const int LIGHTMAP_SIZE = 512;               // Texels por lado
+const int LIGHTMAP_SAMPLES = 16;             // Rayos de sombra por texel en la penumbra
+const int LIGHTMAP_PROBE_SAMPLES = 4;        // Rayos de prueba: si coinciden, el texel no está en la penumbra
+const float SUN_ANGULAR_RADIUS = 0.02f;      // Radio angular del sol en radianes (ancho de la penumbra)
+const float LIGHTMAP_SHADOW_STRENGTH = 0.85f; // Igual que el factor de sombra del shader
+const int BAKE_LEAF_TRIANGLES = 4;           // Triángulos máximos por hoja del BVH
+const int LIGHTMAP_SETTLE_FRAMES = 15;       // Frames sin cambios antes de hornear
+const float LIGHTMAP_BAKE_BUDGET_MS = 6.0f;  // Tiempo de horneado por frame
+const unsigned LIGHTMAP_BAKE_CHUNK = 4096;   // Texels por ParallelFor
+const char* LIGHTMAP_CACHE_DIR = "lightmap_cache";
+const unsigned LIGHTMAP_CACHE_MAGIC = 0x50414D4C; // "LMAP"
+GLuint LightmapTex = 0;                      // RG8 con mipmaps
+unsigned long long LightmapKey = 0;          // Estado de la escena horneado en LightmapTex (0 = ninguno)
+unsigned long long LightmapSceneKey = 0;     // Estado de la escena en este frame
+unsigned LightmapStableFrames = 0;           // Frames seguidos con la misma clave
+LightmapBake ActiveBake;
+float LightmapBakeMs = 0.0f;                 // Tiempo de CPU del último horneado
+bool LightmapFromCache = false;              // El lightmap actual se leyó del disco
+unsigned LightmapBakes = 0;                  // Horneados completados
+unsigned LightmapCacheHits = 0;              // Lightmaps leídos del disco
+std::vector<Vertex> HouseVertices, GroundVertices; // Copias en CPU de las mallas para el horneado
+std::vector<GLuint> HouseIndices, GroundIndices;
+
+// =======================================================================
+// Trazas de CPU (formato Chrome trace-event / Perfetto)
+// =======================================================================
+// TRACE_SCOPE("Nombre") mide el ámbito actual. Cada hilo escribe en su propio
+// anillo sin locks; solo el registro del hilo (una vez) toma un mutex. Con las
+// trazas desactivadas el coste es una lectura y un salto. El nombre debe ser
+// un literal (se guarda el puntero).
+const unsigned TRACE_BUFFER_EVENTS = 1 << 16; // Eventos por hilo antes de sobrescribir
+
+struct TraceEvent
+{
+    std::atomic<unsigned> sequence; // writePos + 1 del evento publicado; 0 mientras se escribe
+    const char* name;
+    long long startNs; // Desde TraceEpoch
+    long long durationNs;
+};
+
+struct TraceBuffer
+{
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+    std::atomic<unsigned> writePos; // Total de eventos escritos (el índice es módulo el tamaño)
+    int threadId;
+    char threadName[32];
+};
+
+std::atomic<bool> TraceEnabled(false); // Activado con RASTER_TRACE=1 o --trace
+FrameClock::time_point TraceEpoch = FrameClock::now();
+std::mutex TraceRegistryMutex;
+std::vector<TraceBuffer*> TraceBuffers; // Un buffer por hilo que haya emitido trazas
+thread_local TraceBuffer* ThreadTraceBuffer = NULL;
+thread_local const char* ThreadTraceName = NULL;
+
+void SetTraceThreadName(const char* name) // Nombre del hilo actual en la traza
+{
+    ThreadTraceName = name;
+    if (ThreadTraceBuffer)
+        snprintf(ThreadTraceBuffer->threadName, sizeof(ThreadTraceBuffer->threadName), "%s", name);
+}
+
+TraceBuffer* GetThreadTraceBuffer() // Buffer del hilo actual (se crea la primera vez)
+{
+    if (!ThreadTraceBuffer)
+    {
+        TraceBuffer* buffer = new TraceBuffer();
+        buffer->writePos.store(0, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(TraceRegistryMutex);
+        buffer->threadId = (int)TraceBuffers.size();
+        snprintf(buffer->threadName, sizeof(buffer->threadName), "%s",
+                ThreadTraceName ? ThreadTraceName : "Worker");
+        TraceBuffers.push_back(buffer);
+        ThreadTraceBuffer = buffer;
+    }
+    return ThreadTraceBuffer;
+}
+
+class TraceScope // Temporizador RAII para TRACE_SCOPE
+{
+public:
+    explicit TraceScope(const char* name) : name_(name), active_(TraceEnabled.load(std::memory_order_relaxed))
+    {
+        if (active_)
+            start_ = FrameClock::now();
+    }
+
+    ~TraceScope()
+    {
+        if (!active_)
+            return;
+
+        FrameClock::time_point end = FrameClock::now();
+        TraceBuffer* buffer = GetThreadTraceBuffer();
+        unsigned pos = buffer->writePos.load(std::memory_order_relaxed);
+
+        TraceEvent& event = buffer->events[pos % TRACE_BUFFER_EVENTS];
+        event.sequence.store(0, std::memory_order_relaxed); // Marcar el slot en curso antes de tocarlo
+        std::atomic_thread_fence(std::memory_order_release);
+        event.name = name_;
+        event.startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(start_ - TraceEpoch).count();
+        event.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_).count();
+
+        event.sequence.store(pos + 1, std::memory_order_release);
+        buffer->writePos.store(pos + 1, std::memory_order_release); // Publicar el evento
+    }
+
+private:
+    const char* name_;
+    bool active_;
+    FrameClock::time_point start_;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+
+void WriteTraceJSON(const char* path) // Volcar todos los buffers como trace-event JSON
+{
+    if (!TraceEnabled.load(std::memory_order_relaxed))
+        return;
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("ERROR: no se pudo escribir %s\n", path);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(TraceRegistryMutex);
+    size_t written = 0;
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (size_t b = 0; b < TraceBuffers.size(); b++)
+    {
+        TraceBuffer* buffer = TraceBuffers[b];
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                b == 0 ? "" : ",\n", buffer->threadId, buffer->threadName);
+
+        // Solo los eventos publicados; si el anillo dio la vuelta, los más recientes.
+        // El hilo dueño puede seguir escribiendo: se copia cada evento y se
+        // descarta si su secuencia no es la esperada antes y después de copiarlo.
+        unsigned end = buffer->writePos.load(std::memory_order_acquire);
+        unsigned begin = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+        for (unsigned i = begin; i < end; i++)
+        {
+            TraceEvent& event = buffer->events[i % TRACE_BUFFER_EVENTS];
+            if (event.sequence.load(std::memory_order_acquire) != i + 1)
+                continue; // En curso o ya sobrescrito
+
+            const char* name = event.name;
+            long long startNs = event.startNs;
+            long long durationNs = event.durationNs;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (event.sequence.load(std::memory_order_relaxed) != i + 1)
+                continue; // Sobrescrito mientras se copiaba
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    name, buffer->threadId, startNs / 1000.0, durationNs / 1000.0);
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Traza guardada en %s (%zu eventos, %zu hilos)\n", path, written, TraceBuffers.size());
+}
+
+// =======================================================================
+// Job System
+// =======================================================================
+// Pool fijo de hilos para trabajo por índices. ParallelFor reparte [0, count)
+// en trozos de 'grain' que los workers toman con un contador atómico; el hilo
+// que llama también trabaja y vuelve cuando todos han terminado.
+const unsigned MAX_JOB_WORKERS = 15;
+
+class JobSystem
+{
+public:
+    JobSystem() : stop_(false), generation_(0), func_(NULL), count_(0), grain_(1), pending_(0) { next_.store(0); }
+    ~JobSystem() { Stop(); }
+
+    void Start(unsigned workerCount) // Crear los workers (0 = todo en el hilo que llama)
+    {
+        workerCount = std::min(workerCount, MAX_JOB_WORKERS);
+        for (unsigned i = 0; i < workerCount; i++)
+        {
+            snprintf(names_[i], sizeof(names_[i]), "Job %u", i + 1);
+            workers_.push_back(std::thread(&JobSystem::WorkerMain, this, i));
+        }
+    }
+
+    void Stop() // Terminar y unir los workers
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (size_t i = 0; i < workers_.size(); i++)
+            workers_[i].join();
+        workers_.clear();
+    }
+
+    unsigned ThreadCount() const { return (unsigned)workers_.size() + 1; }
+
+    void ParallelFor(unsigned count, unsigned grain, const std::function<void(unsigned, unsigned)>& func)
+    {
+        grain = std::max(grain, 1u);
+        if (workers_.empty() || count <= grain)
+        {
+            if (count > 0)
+                func(0, count);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            func_ = &func;
+            count_ = count;
+            grain_ = grain;
+            next_.store(0);
+            pending_ = (unsigned)workers_.size();
+            generation_++;
+        }
+        wake_.notify_all();
+
+        RunChunks();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (pending_ > 0)
+            done_.wait(lock);
+        func_ = NULL;
+    }
+
+private:
+    void RunChunks() // Tomar trozos hasta agotar el rango
+    {
+        for (;;)
+        {
+            unsigned begin = next_.fetch_add(grain_);
+            if (begin >= count_)
+                break;
+            (*func_)(begin, std::min(begin + grain_, count_));
+        }
+    }
+
+    void WorkerMain(unsigned index)
+    {
+        SetTraceThreadName(names_[index]);
+        unsigned seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (!stop_ && generation_ == seen)
+                    wake_.wait(lock);
+                if (stop_)
+                    return;
+                seen = generation_;
+            }
+
+            RunChunks();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0)
+                done_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    char names_[MAX_JOB_WORKERS][16];       // Nombres de hilo para la traza
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    bool stop_;
+    unsigned generation_;                   // Trabajo actual (los workers esperan a que cambie)
+    const std::function<void(unsigned, unsigned)>* func_;
+    unsigned count_, grain_;
+    std::atomic<unsigned> next_;            // Siguiente índice libre
+    unsigned pending_;                      // Workers que aún no terminaron el trabajo actual
+};
+
+JobSystem Jobs;
+int JobWorkerCount = -1; // Workers pedidos con --threads (-1 = núcleos - 1)
+
 // =======================================================================
 // OBJ Loader
 // =======================================================================
@@ -69,6 +782,8 @@ bool LoadOBJ(const std::string& path, // Carga un modelo OBJ desde archivo
             std::vector<Vertex>& outVertices,
             std::vector<GLuint>& outIndices)
 {
+    TRACE_SCOPE("LoadOBJ");
+
     std::ifstream file(path);
     if (!file.is_open()) {
         std::cout << "ERROR: no se pudo abrir: " << path << std::endl;
@@ -215,444 +930,4018 @@ bool LoadOBJ(const std::string& path, // Carga un modelo OBJ desde archivo
 
 
 // =======================================================================
-// Load Texture
+// Texture Streaming
 // =======================================================================
-GLuint LoadTexture(const char* path) // Carga una textura desde archivo
+// Las texturas se decodifican en hilos de carga propios (un stbi_load largo en un
+// worker del job system retrasaría el ParallelFor de ese frame). Cada imagen
+// decodificada se entrega al hilo de GL por una pila sin locks y se sube por
+// franjas de filas a través de un PBO, con un presupuesto de bytes por frame.
+// Hasta entonces los draws usan una textura de 1x1; al terminar, la global que
+// la referencia pasa a la textura real.
+//
+// Con compresión, la imagen se cocina en los mismos hilos: cadena de mips en CPU
+// y bloques BC1 (opaca: 0.5 bytes/texel) o BC7 modo 6 (alfa o --texture-bc7: 1
+// byte/texel), repartidos en bandas de filas de bloques. El resultado se guarda
+// como DDS en texture_cache/ con el hash del contenido, y la siguiente carga lo
+// lee sin decodificar ni comprimir
+const unsigned TEXTURE_LOAD_THREADS_MIN = 2;    // Hilos de carga (al menos; si no, la mitad de los núcleos)
+float TextureUploadBudgetMB = 4.0f;             // --texture-upload-budget MB: bytes subidos por frame
+const unsigned char TEXTURE_PLACEHOLDER_COLOR[4] = { 160, 160, 160, 255 }; // Gris neutro
+bool TextureCompression = true;                 // --no-texture-compression: subir RGBA8 como antes
+bool TextureForceBC7 = false;                   // --texture-bc7: BC7 también para las opacas (más calidad)
+bool TextureBC1Supported = false;               // EXT_texture_compression_s3tc (BC7 es núcleo en 4.2)
+const int TEXTURE_COOK_BAND_BLOCKS = 16;        // Filas de bloques por tarea de compresión
+const unsigned TEXTURE_COOKER_VERSION = 1;      // Cambia la clave de la caché al cambiar el compresor
+const char* TEXTURE_CACHE_DIR = "texture_cache";
+
+class TaskQueue // Hilos para trabajos largos e independientes (cola FIFO)
 {
-    int w, h, comp;
-    unsigned char* data = stbi_load(path, &w, &h, &comp, STBI_rgb_alpha);
+public:
+    TaskQueue() : stop_(false) {}
+    ~TaskQueue() { Stop(); }
+
+    void Start(unsigned threadCount, const char* name) // Crear los hilos
+    {
+        threadCount = std::min(threadCount, MAX_JOB_WORKERS);
+        for (unsigned i = 0; i < threadCount; i++)
+        {
+            snprintf(names_[i], sizeof(names_[i]), "%s %u", name, i + 1);
+            threads_.push_back(std::thread(&TaskQueue::ThreadMain, this, i));
+        }
+    }
+
+    void Submit(const std::function<void()>& task) // Encolar (sin hilos, se ejecuta en el acto)
+    {
+        if (threads_.empty())
+        {
+            task();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(task);
+        }
+        wake_.notify_one();
+    }
 
-    if (!data) {
-        std::cout << "ERROR cargando textura: " << path << std::endl;
-        return 0;
+    void Stop() // Descartar lo pendiente, esperar a los trabajos en curso y unir los hilos
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            tasks_.clear();
+        }
+        wake_.notify_all();
+        for (size_t i = 0; i < threads_.size(); i++)
+            threads_[i].join();
+        threads_.clear();
     }
 
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
+private:
+    void ThreadMain(unsigned index)
+    {
+        SetTraceThreadName(names_[index]);
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (!stop_ && tasks_.empty())
+                    wake_.wait(lock);
+                if (stop_)
+                    return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0,
-                GL_RGBA, GL_UNSIGNED_BYTE, data);
+    std::vector<std::thread> threads_;
+    char names_[MAX_JOB_WORKERS][16];       // Nombres de hilo para la traza
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::function<void()> > tasks_;
+    bool stop_;
+};
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+struct TextureLevel // Un nivel de mip comprimido dentro de TextureLoad::blocks
+{
+    int width, height;
+    size_t offset, size;
+};
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+struct TextureLoad // Textura en camino: ruta -> píxeles o bloques (hilos de carga) -> franjas (hilo de GL)
+{
+    std::string path;
+    GLuint* target;          // Global que usan los draws (placeholder hasta terminar)
+    GLenum format;           // GL_RGBA8 o formato comprimido (0 = falló)
+    unsigned char* pixels;   // RGBA8 de stbi_load (sin compresión, o nivel 0 mientras se cocina)
+    int width, height;
+    std::vector<std::vector<unsigned char> > mipPixels; // Niveles 1.. en RGBA8 mientras se cocina
+    std::vector<unsigned char> blocks;                  // Todos los niveles comprimidos, seguidos
+    std::vector<TextureLevel> levels;
+    std::atomic<unsigned> bandsLeft;                    // Bandas sin comprimir (la última cierra la textura)
+    unsigned long long cacheKey;
+    bool fromCache;
+    GLuint texture;          // Textura real (se crea al empezar la subida)
+    GLuint pbo;              // Buffer de desempaquetado del tamaño de la imagen
+    int uploadedRows;        // Progreso sin compresión (filas del nivel 0)
+    size_t uploadedLevels;   // Progreso comprimido (niveles enteros)
+    unsigned slices;         // Franjas subidas (frames que ocupó)
+    FrameClock::time_point requested;
+    FrameClock::time_point cookStart;
+    float decodeMs, cookMs;
+    TextureLoad* next;       // Enlace en la pila de decodificadas
+};
 
-    stbi_image_free(data);
-    return tex;
+TaskQueue TextureLoader;
+std::atomic<TextureLoad*> DecodedTextures(NULL); // Pila sin locks: hilos de carga -> hilo de GL
+std::vector<TextureLoad*> TextureLoads;          // Todas las cargas en curso (dueño: hilo de GL)
+std::vector<TextureLoad*> TextureUploads;        // Decodificadas en orden de llegada, pendientes de subir
+GLuint TexturePlaceholder = 0;                   // 1x1 compartida mientras no hay textura real
+unsigned TexturesPending = 0;                    // Pedidas y aún sin terminar (ni fallar)
+unsigned TexturesReady = 0;
+size_t TextureMemoryBytes = 0;                   // Memoria de las texturas subidas (con mips)
+
+const char* TextureFormatName(GLenum format) // Nombre corto para el título y los mensajes
+{
+    if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+        return "BC1";
+    if (format == GL_COMPRESSED_RGBA_BPTC_UNORM)
+        return "BC7";
+    return "RGBA8";
 }
 
-// =======================================================================
-// Update Window Title with Stats
-// =======================================================================
-void UpdateWindowTitle() // Actualizar título de la ventana con estadísticas
+void PublishTexture(TextureLoad* load) // Hilo de carga: entregar al hilo de GL (pila sin locks)
 {
-    char title[256];
-    
-    // Calcular total de triángulos
-    size_t totalTriangles = (IndexCount / 3) + (GroundIndexCount / 3);
-    size_t totalVertices = IndexCount + GroundIndexCount;
-    
-    // Formato: Título | FPS | Triángulos | Vértices | Shadow Map
-    sprintf(title, "%s | FPS: %.1f | Tris: %zu | Verts: %zu | Shadow: %dx%d | Rot: %s",
-            WINDOW_TITLE_PREFIX,
-            FPS,
-            totalTriangles,
-            totalVertices,
-            SHADOW_WIDTH,
-            SHADOW_HEIGHT,
-            AutoRotate ? "AUTO" : "MANUAL");
-    
-    glutSetWindowTitle(title);
+    TextureLoad* head = DecodedTextures.load(std::memory_order_relaxed);
+    do
+        load->next = head;
+    while (!DecodedTextures.compare_exchange_weak(head, load, std::memory_order_release, std::memory_order_relaxed));
 }
 
-// =======================================================================
-// Prototipos
-// =======================================================================
-void Initialize(int, char*[]); // Inicialización
-void InitWindow(int, char*[]); // Ventana
-void ResizeFunction(int, int); // Resize
-void RenderFunction(void); // Render
-void TimerFunction(int); // Timer
-void IdleFunction(void); // Idle
-void CleanUp(void); // Limpieza
-void CreateOBJ(void); // Crear objeto
-void DrawOBJ(void); // Dibujar objeto
-void CreateGround(void); // Crear suelo
-void DrawGround(void); // Dibujar suelo
-void KeyboardFunction(unsigned char, int, int); // Función de teclado
-void CreateShadowMap(void); // Crear mapa de sombras
-void RenderShadowPass(void); // Renderizar pase de sombras 
-void UpdateWindowTitle(void); // Actualizar título de ventana
-// =======================================================================
-// MAIN
-// =======================================================================
-int main(int argc, char* argv[]) // Función principal
+void TextureCachePath(unsigned long long key, char* path, size_t size) // Archivo de la caché para un contenido
 {
-    Initialize(argc, argv); // Inicialización
-    glutMainLoop(); // Bucle principal de GLUT
-    return 0;
+    snprintf(path, size, "%s/%016llx.dds", TEXTURE_CACHE_DIR, key);
 }
 
-// =======================================================================
-// Inicialización
-// =======================================================================
-void Initialize(int argc, char* argv[]) // Inicialización
+// Cabecera DDS (magia + DDS_HEADER en palabras de 32 bits) y extensión DX10 para BC7
+const unsigned DDS_MAGIC = 0x20534444;        // "DDS "
+const unsigned DDS_FOURCC_DXT1 = 0x31545844;  // "DXT1"
+const unsigned DDS_FOURCC_DX10 = 0x30315844;  // "DX10"
+const unsigned DXGI_FORMAT_BC7_UNORM = 98;
+
+bool LoadCompressedTexture(TextureLoad* load) // Leer bloques cocinados antes (false = no están o no valen)
 {
-    InitWindow(argc, argv);
+    char path[64];
+    TextureCachePath(load->cacheKey, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
 
-    if (glewInit() != GLEW_OK)
+    unsigned header[32] = {0}, dx10[5] = {0};
+    bool valid = fread(header, sizeof(header), 1, file) == 1 && header[0] == DDS_MAGIC && header[1] == 124 &&
+                 header[3] > 0 && header[4] > 0 && header[7] > 0 && (std::max(header[3], header[4]) >> (header[7] - 1)) > 0;
+    if (valid && header[21] == DDS_FOURCC_DX10)
+        valid = fread(dx10, sizeof(dx10), 1, file) == 1 && dx10[0] == DXGI_FORMAT_BC7_UNORM;
+    if (valid)
     {
-        std::cout << "Error inicializando GLEW\n";
-        exit(1);
+        load->format = header[21] == DDS_FOURCC_DXT1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM;
+        valid = header[21] == DDS_FOURCC_DXT1 || header[21] == DDS_FOURCC_DX10;
+    }
+    if (valid)
+    {
+        // Los tamaños de los niveles salen de las dimensiones; el archivo debe tenerlos todos
+        load->width = (int)header[4];
+        load->height = (int)header[3];
+        size_t blockBytes = load->format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+        size_t total = 0;
+        for (unsigned level = 0; level < header[7]; level++)
+        {
+            TextureLevel lv;
+            lv.width = std::max(load->width >> level, 1);
+            lv.height = std::max(load->height >> level, 1);
+            lv.offset = total;
+            lv.size = (size_t)((lv.width + 3) / 4) * ((lv.height + 3) / 4) * blockBytes;
+            total += lv.size;
+            load->levels.push_back(lv);
+        }
+        load->blocks.resize(total);
+        valid = fread(load->blocks.data(), 1, total, file) == total && fgetc(file) == EOF;
     }
+    fclose(file);
+    if (!valid)
+    {
+        load->format = 0;
+        load->levels.clear();
+        load->blocks.clear();
+        remove(path);
+        printf("AVISO: textura comprimida %s dañada, se cocina de nuevo\n", path);
+    }
+    return valid;
+}
 
-    printf("OpenGL Version: %s\n", glGetString(GL_VERSION));
+void SaveCompressedTexture(const TextureLoad* load) // Guardar los bloques cocinados como DDS
+{
+#ifdef _WIN32
+    _mkdir(TEXTURE_CACHE_DIR);
+#else
+    mkdir(TEXTURE_CACHE_DIR, 0755);
+#endif
+    char path[64];
+    TextureCachePath(load->cacheKey, path, sizeof(path));
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return;
 
-    ModelMatrix      = IDENTITY_MATRIX;
-    ProjectionMatrix = IDENTITY_MATRIX;
-    ViewMatrix       = IDENTITY_MATRIX;
+    bool bc7 = load->format == GL_COMPRESSED_RGBA_BPTC_UNORM;
+    unsigned header[32] = {0};
+    header[0] = DDS_MAGIC;
+    header[1] = 124;                                  // dwSize
+    header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // CAPS, HEIGHT, WIDTH, PIXELFORMAT, MIPMAPCOUNT, LINEARSIZE
+    header[3] = (unsigned)load->height;
+    header[4] = (unsigned)load->width;
+    header[5] = (unsigned)load->levels[0].size;       // Tamaño del nivel 0
+    header[7] = (unsigned)load->levels.size();
+    header[19] = 32;                                  // DDS_PIXELFORMAT.dwSize
+    header[20] = 0x4;                                 // DDPF_FOURCC
+    header[21] = bc7 ? DDS_FOURCC_DX10 : DDS_FOURCC_DXT1;
+    header[27] = 0x1000 | 0x400000 | 0x8;             // TEXTURE, MIPMAP, COMPLEX
+    unsigned dx10[5] = { DXGI_FORMAT_BC7_UNORM, 3, 0, 1, 0 }; // Formato, TEXTURE2D, flags, 1 capa, alfa
 
-    // Cámara ajustada para mejor vista
-    TranslateMatrix(&ViewMatrix, 0.0f, -1.8f, -7.5f);
+    bool written = fwrite(header, sizeof(header), 1, file) == 1 &&
+                   (!bc7 || fwrite(dx10, sizeof(dx10), 1, file) == 1) &&
+                   fwrite(load->blocks.data(), 1, load->blocks.size(), file) == load->blocks.size();
+    fclose(file);
+    if (!written)
+        remove(path); // No dejar archivos a medias
+}
 
-    // Fondo más cálido/beige como la imagen
-    glClearColor(0.82f, 0.76f, 0.65f, 1.0f);
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
+const unsigned char* TextureLevelPixels(const TextureLoad* load, size_t level) // RGBA8 de un nivel mientras se cocina
+{
+    return level == 0 ? load->pixels : load->mipPixels[level - 1].data();
+}
 
-    CreateOBJ();
-    CreateGround();
-    CreateShadowMap();
-    
-    // Inicializar tiempo para FPS
-    FPSLastTime = clock();
+void FinishTextureCook(TextureLoad* load) // Última banda: soltar el RGBA8, guardar en la caché y entregar
+{
+    load->cookMs = std::chrono::duration<float, std::milli>(FrameClock::now() - load->cookStart).count();
+    stbi_image_free(load->pixels);
+    load->pixels = NULL;
+    std::vector<std::vector<unsigned char> >().swap(load->mipPixels);
+    SaveCompressedTexture(load);
+    PublishTexture(load);
 }
 
-// =======================================================================
-// Ventana
-// =======================================================================
-void InitWindow(int argc, char* argv[]) // Inicializa la ventana GLUT
+void CookTextureBand(TextureLoad* load, size_t level, int firstRow, int lastRow) // Comprimir filas de bloques de un nivel
 {
-    glutInit(&argc, argv);
-    glutInitContextVersion(4, 3);
-    glutInitContextProfile(GLUT_CORE_PROFILE);
-    glutInitWindowSize(CurrentWidth, CurrentHeight);
-    glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
+    TRACE_SCOPE("CookTextureBand");
+    const TextureLevel& lv = load->levels[level];
+    const unsigned char* image = TextureLevelPixels(load, level);
+    bool bc1 = load->format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    int blocksX = (lv.width + 3) / 4;
+    size_t blockBytes = bc1 ? 8 : 16;
 
-    WindowHandle = glutCreateWindow(WINDOW_TITLE_PREFIX);
+    unsigned char block[64];
+    for (int by = firstRow; by < lastRow; by++)
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            ExtractBlockRGBA(image, lv.width, lv.height, bx, by, block);
+            unsigned char* out = &load->blocks[lv.offset + ((size_t)by * blocksX + bx) * blockBytes];
+            if (bc1)
+                EncodeBC1Block(block, out);
+            else
+                EncodeBC7Block(block, out);
+        }
 
-    glutReshapeFunc(ResizeFunction);
-    glutDisplayFunc(RenderFunction);
-    glutIdleFunc(IdleFunction);
-    glutTimerFunc(0, TimerFunction, 0);
-    glutCloseFunc(CleanUp);
-    glutKeyboardFunc(KeyboardFunction); // AGREGAR ESTA LÍNEA
+    if (load->bandsLeft.fetch_sub(1) == 1)
+        FinishTextureCook(load); // Las demás bandas ya escribieron sus bloques
+}
+
+void StartTextureCook(TextureLoad* load) // Elegir formato, generar los mips y repartir la compresión en bandas
+{
+    TRACE_SCOPE("StartTextureCook");
+    load->cookStart = FrameClock::now();
+
+    // BC1 no guarda alfa: solo para imágenes opacas (y si el driver tiene S3TC)
+    bool opaque = true;
+    for (size_t i = 3; i < (size_t)load->width * load->height * 4 && opaque; i += 4)
+        opaque = load->pixels[i] == 255;
+    bool bc1 = opaque && !TextureForceBC7 && TextureBC1Supported;
+    load->format = bc1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    size_t blockBytes = bc1 ? 8 : 16;
+
+    // Cadena de mips en CPU (glGenerateMipmap no sirve para formatos comprimidos)
+    size_t total = 0;
+    for (int level = 0; ; level++)
+    {
+        TextureLevel lv;
+        lv.width = std::max(load->width >> level, 1);
+        lv.height = std::max(load->height >> level, 1);
+        lv.offset = total;
+        lv.size = (size_t)((lv.width + 3) / 4) * ((lv.height + 3) / 4) * blockBytes;
+        total += lv.size;
+        if (level > 0)
+        {
+            const TextureLevel& parent = load->levels[level - 1];
+            load->mipPixels.push_back(std::vector<unsigned char>((size_t)lv.width * lv.height * 4));
+            DownsampleRGBA(TextureLevelPixels(load, level - 1), parent.width, parent.height, load->mipPixels.back().data());
+        }
+        load->levels.push_back(lv);
+        if (lv.width == 1 && lv.height == 1)
+            break;
+    }
+    load->blocks.resize(total);
+
+    // Bandas de filas de bloques para todos los hilos de carga; nadie espera a nadie
+    unsigned bands = 0;
+    for (size_t level = 0; level < load->levels.size(); level++)
+        bands += ((load->levels[level].height + 3) / 4 + TEXTURE_COOK_BAND_BLOCKS - 1) / TEXTURE_COOK_BAND_BLOCKS;
+    load->bandsLeft.store(bands);
+    for (size_t level = 0; level < load->levels.size(); level++)
+    {
+        int rows = (load->levels[level].height + 3) / 4;
+        for (int first = 0; first < rows; first += TEXTURE_COOK_BAND_BLOCKS)
+        {
+            int last = std::min(first + TEXTURE_COOK_BAND_BLOCKS, rows);
+            TextureLoader.Submit([load, level, first, last]() { CookTextureBand(load, level, first, last); });
+        }
+    }
+}
+
+bool ReadFileBytes(const char* path, std::vector<unsigned char>& data) // Leer un archivo entero
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data.resize(size > 0 ? (size_t)size : 0);
+    bool valid = size > 0 && fread(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    return valid;
+}
+
+void DecodeTexture(TextureLoad* load) // Hilo de carga: leer de la caché o decodificar (y cocinar si se comprime)
+{
+    TRACE_SCOPE("DecodeTexture");
+    FrameClock::time_point start = FrameClock::now();
+
+    std::vector<unsigned char> file;
+    if (!ReadFileBytes(load->path.c_str(), file))
+    {
+        PublishTexture(load); // format = 0: se queda el placeholder
+        return;
+    }
+
+    // Clave: contenido del archivo y todo lo que cambia el resultado del compresor
+    if (TextureCompression)
+    {
+        load->cacheKey = HashBytes(file.data(), file.size(), HASH_BYTES_SEED);
+        load->cacheKey = HashBytes(&TEXTURE_COOKER_VERSION, sizeof(TEXTURE_COOKER_VERSION), load->cacheKey);
+        load->cacheKey = HashBytes(&TextureForceBC7, sizeof(TextureForceBC7), load->cacheKey);
+        load->cacheKey = HashBytes(&TextureBC1Supported, sizeof(TextureBC1Supported), load->cacheKey);
+        if (LoadCompressedTexture(load))
+        {
+            load->fromCache = true;
+            load->decodeMs = std::chrono::duration<float, std::milli>(FrameClock::now() - start).count();
+            PublishTexture(load);
+            return;
+        }
+    }
+
+    int comp;
+    load->pixels = stbi_load_from_memory(file.data(), (int)file.size(), &load->width, &load->height, &comp, STBI_rgb_alpha);
+    load->decodeMs = std::chrono::duration<float, std::milli>(FrameClock::now() - start).count();
+    if (!load->pixels || !TextureCompression)
+    {
+        load->format = load->pixels ? GL_RGBA8 : 0;
+        PublishTexture(load);
+        return;
+    }
+    StartTextureCook(load);
+}
+
+void LoadTextureAsync(const char* path, GLuint* target) // Pedir una textura: placeholder ya, la real al terminar de subirla
+{
+    if (!TexturePlaceholder)
+    {
+        glGenTextures(1, &TexturePlaceholder);
+        glBindTexture(GL_TEXTURE_2D, TexturePlaceholder);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, TEXTURE_PLACEHOLDER_COLOR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    *target = TexturePlaceholder;
+
+    TextureLoad* load = new TextureLoad();
+    load->path = path;
+    load->target = target;
+    load->format = 0;
+    load->pixels = NULL;
+    load->width = load->height = 0;
+    load->bandsLeft.store(0);
+    load->cacheKey = 0;
+    load->fromCache = false;
+    load->texture = 0;
+    load->pbo = 0;
+    load->uploadedRows = 0;
+    load->uploadedLevels = 0;
+    load->slices = 0;
+    load->requested = FrameClock::now();
+    load->decodeMs = load->cookMs = 0.0f;
+    load->next = NULL;
+    TextureLoads.push_back(load);
+    TexturesPending++;
+
+    TextureLoader.Submit([load]() { DecodeTexture(load); });
+}
+
+void FreeTextureLoad(TextureLoad* load) // Liberar píxeles, PBO y el registro
+{
+    if (load->pixels)
+        stbi_image_free(load->pixels);
+    if (load->pbo)
+        glDeleteBuffers(1, &load->pbo);
+    TextureLoads.erase(std::find(TextureLoads.begin(), TextureLoads.end(), load));
+    delete load;
+}
+
+void BeginTextureUpload(TextureLoad* load) // Reservar la textura inmutable y el PBO
+{
+    int levels = (int)load->levels.size();
+    size_t bytes = load->blocks.size();
+    if (load->format == GL_RGBA8)
+    {
+        levels = 1;
+        while ((std::max(load->width, load->height) >> levels) > 0)
+            levels++;
+        bytes = (size_t)load->width * load->height * 4;
+    }
+
+    glGenTextures(1, &load->texture);
+    glBindTexture(GL_TEXTURE_2D, load->texture);
+    glTexStorage2D(GL_TEXTURE_2D, levels, load->format, load->width, load->height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glGenBuffers(1, &load->pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, load->pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)bytes, NULL, GL_STREAM_DRAW);
+}
+
+size_t UploadCompressedLevel(TextureLoad* load) // Subir el siguiente nivel comprimido entero por el PBO
+{
+    const TextureLevel& lv = load->levels[load->uploadedLevels];
+    void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, lv.offset, lv.size,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (dst)
+    {
+        memcpy(dst, load->blocks.data() + lv.offset, lv.size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)load->uploadedLevels, 0, 0, lv.width, lv.height,
+                                  load->format, (GLsizei)lv.size, (const void*)lv.offset);
+    }
+    else
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)load->uploadedLevels, 0, 0, lv.width, lv.height,
+                                  load->format, (GLsizei)lv.size, load->blocks.data() + lv.offset);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, load->pbo);
+    }
+    load->uploadedLevels++;
+    return lv.size;
+}
+
+void PumpTextureUploads() // Recoger las decodificadas y subir franjas hasta agotar el presupuesto (una vez por frame)
+{
+    if (TexturesPending == 0)
+        return;
+    TRACE_SCOPE("PumpTextureUploads");
+
+    // La pila sale en orden inverso: darle la vuelta para subir en orden de llegada
+    TextureLoad* decoded = DecodedTextures.exchange(NULL, std::memory_order_acquire);
+    size_t first = TextureUploads.size();
+    for (; decoded; decoded = decoded->next)
+        TextureUploads.push_back(decoded);
+    std::reverse(TextureUploads.begin() + first, TextureUploads.end());
+
+    size_t budget = (size_t)(TextureUploadBudgetMB * 1024.0f * 1024.0f);
+    glActiveTexture(GL_TEXTURE0);
+    while (!TextureUploads.empty() && budget > 0)
+    {
+        TextureLoad* load = TextureUploads.front();
+        if (!load->format)
+        {
+            std::cout << "ERROR cargando textura: " << load->path << std::endl;
+            printf("Asegurate que el archivo este en el mismo directorio que el .exe\n");
+            TextureUploads.erase(TextureUploads.begin());
+            TexturesPending--;
+            FreeTextureLoad(load); // Se queda el placeholder
+            continue;
+        }
+
+        if (!load->texture)
+            BeginTextureUpload(load);
+        else
+        {
+            glBindTexture(GL_TEXTURE_2D, load->texture);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, load->pbo);
+        }
+
+        size_t memory = 0;
+        if (load->format != GL_RGBA8)
+        {
+            // Comprimida: niveles enteros (ya traen sus mips) mientras quede presupuesto, al menos uno
+            do
+                budget -= std::min(budget, UploadCompressedLevel(load));
+            while (budget > 0 && load->uploadedLevels < load->levels.size());
+            load->slices++;
+            if (load->uploadedLevels < load->levels.size())
+                break; // Presupuesto agotado a mitad de la cadena
+            memory = load->blocks.size();
+        }
+        else
+        {
+            // Franja de filas: copiar a su zona del PBO (nunca escrita antes, sin sincronizar) y subir desde ahí
+            size_t rowBytes = (size_t)load->width * 4;
+            int rows = std::min(load->height - load->uploadedRows, std::max((int)(budget / rowBytes), 1));
+            size_t offset = (size_t)load->uploadedRows * rowBytes;
+            size_t bytes = (size_t)rows * rowBytes;
+            void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, bytes,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (dst)
+            {
+                memcpy(dst, load->pixels + offset, bytes);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, load->uploadedRows, load->width, rows,
+                                GL_RGBA, GL_UNSIGNED_BYTE, (const void*)offset);
+            }
+            else
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // Sin mapeo: subir directamente desde la memoria del cliente
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, load->uploadedRows, load->width, rows,
+                                GL_RGBA, GL_UNSIGNED_BYTE, load->pixels + offset);
+            }
+            load->uploadedRows += rows;
+            load->slices++;
+            budget -= std::min(budget, bytes);
+
+            if (load->uploadedRows < load->height)
+                break; // Presupuesto agotado a mitad de la imagen
+
+            glGenerateMipmap(GL_TEXTURE_2D);
+            memory = (size_t)load->width * load->height * 4 * 4 / 3;
+        }
+
+        *load->target = load->texture;
+        TextureMemoryBytes += memory;
+        char source[64]; // De dónde salieron los texels
+        if (load->fromCache)
+            snprintf(source, sizeof(source), "leída de %s/ en %.1f ms", TEXTURE_CACHE_DIR, load->decodeMs);
+        else if (load->format != GL_RGBA8)
+            snprintf(source, sizeof(source), "decodificada en %.1f ms, comprimida en %.1f ms", load->decodeMs, load->cookMs);
+        else
+            snprintf(source, sizeof(source), "decodificada en %.1f ms", load->decodeMs);
+        printf("Textura cargada exitosamente: %s (ID: %u, %dx%d %s, %.2f MB, %s, %u franjas, lista a los %.1f ms)\n",
+               load->path.c_str(), load->texture, load->width, load->height, TextureFormatName(load->format),
+               memory / (1024.0 * 1024.0), source, load->slices,
+               std::chrono::duration<float, std::milli>(FrameClock::now() - load->requested).count());
+        TextureUploads.erase(TextureUploads.begin());
+        TexturesPending--;
+        TexturesReady++;
+        FreeTextureLoad(load);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // Las demás subidas leen de memoria del cliente
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void DeleteTextureLoads() // Parar los hilos de carga y liberar lo que quede en camino
+{
+    TextureLoader.Stop();
+    while (!TextureLoads.empty())
+    {
+        TextureLoad* load = TextureLoads.back();
+        if (load->texture && *load->target != load->texture)
+            glDeleteTextures(1, &load->texture);
+        FreeTextureLoad(load);
+    }
+    TextureUploads.clear();
+    DecodedTextures.store(NULL);
+    glDeleteTextures(1, &TexturePlaceholder);
 }
 
 // =======================================================================
-// Resize
+// GPU Timers (queries GL_TIMESTAMP sin bloqueo)
 // =======================================================================
-void ResizeFunction(int W, int H) // Función de resize
+enum GpuTimerId // Pases (y draws opcionales) medidos en GPU
 {
-    CurrentWidth  = W;
-    CurrentHeight = H;
+    GPU_TIMER_SHADOW,
+    GPU_TIMER_SHADOW_BLUR,
+    GPU_TIMER_SPOT_SHADOW,
+    GPU_TIMER_POINT_SHADOW,
+    GPU_TIMER_SHADOW_MASK,
+    GPU_TIMER_PREPASS,
+    GPU_TIMER_MAIN,
+    GPU_TIMER_GBUFFER,
+    GPU_TIMER_DEFERRED_LIGHTING,
+    GPU_TIMER_DRAW_OBJ,
+    GPU_TIMER_DRAW_GROUND,
+    GPU_TIMER_UPSCALE,
+    GPU_TIMER_FRAME,
+    GPU_TIMER_COUNT
+};
 
-    glViewport(0,0,W,H);
+const char* GpuTimerNames[GPU_TIMER_COUNT] = { "Shadow", "Blur", "Spots", "Points", "Mask", "PrePass", "Main", "GBuffer", "Lighting", "DrawOBJ", "DrawGround", "Upscale", "Frame" };
 
-    ProjectionMatrix = CreateProjectionMatrix(
-        60.0f,
-        (float)W / (float)H,
-        0.1f,
-        200.0f
-    );
+const int GPU_TIMER_FRAMES = 3;    // Frames en vuelo antes de leer una query (anillo)
+const int GPU_TIMER_HISTORY = 240; // Muestras para promedio y percentiles
+const int GPU_TIMER_LOG_SIZE = 60 * 60 * 4 * GPU_TIMER_COUNT; // Muestras del CSV (anillo, ~4 min a 60 fps)
+
+struct GpuTimer
+{
+    GLuint queries[GPU_TIMER_FRAMES][2]; // Timestamps inicio/fin por slot del anillo
+    bool pending[GPU_TIMER_FRAMES];      // Slot emitido y pendiente de lectura
+    float history[GPU_TIMER_HISTORY];    // Últimas muestras en ms
+    int historyCount;
+    int historyPos;
+    unsigned sampleCount;                // Muestras leídas en total (para detectar una nueva)
+    float lastMs;                        // Última muestra leída
+};
+
+struct GpuTimerSample // Muestra para el CSV de salida
+{
+    unsigned frame;
+    int timer;
+    float ms;
+};
+
+GpuTimer GpuTimers[GPU_TIMER_COUNT];
+std::vector<GpuTimerSample> GpuTimerLog; // Últimas muestras leídas (anillo, CSV al salir)
+size_t GpuTimerLogPos = 0;   // Siguiente posición a escribir en el anillo
+size_t GpuTimerLogCount = 0; // Muestras válidas en el anillo
+bool GpuTimePerDraw = false; // Medir también cada draw del pase principal
+unsigned GpuTimerSkipped = 0; // Resultados descartados por no estar listos a tiempo
+
+void CreateGpuTimers() // Crear queries del anillo
+{
+    for (int t = 0; t < GPU_TIMER_COUNT; t++)
+    {
+        GpuTimer& timer = GpuTimers[t];
+        for (int f = 0; f < GPU_TIMER_FRAMES; f++)
+        {
+            glGenQueries(2, timer.queries[f]);
+            timer.pending[f] = false;
+        }
+        timer.historyCount = 0;
+        timer.historyPos = 0;
+        timer.sampleCount = 0;
+        timer.lastMs = 0.0f;
+    }
+    GpuTimerLog.resize(GPU_TIMER_LOG_SIZE);
+    GpuTimerLogPos = 0;
+    GpuTimerLogCount = 0;
+}
+
+void CollectGpuTimers(unsigned frame) // Leer el slot que se va a reutilizar (emitido hace GPU_TIMER_FRAMES frames)
+{
+    int slot = frame % GPU_TIMER_FRAMES;
+
+    for (int t = 0; t < GPU_TIMER_COUNT; t++)
+    {
+        GpuTimer& timer = GpuTimers[t];
+        if (!timer.pending[slot])
+            continue;
+        timer.pending[slot] = false;
+
+        GLint available = 0;
+        glGetQueryObjectiv(timer.queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            GpuTimerSkipped++; // Nunca esperar a la GPU
+            continue;
+        }
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(timer.queries[slot][0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(timer.queries[slot][1], GL_QUERY_RESULT, &end);
+        float ms = (float)((double)(end - begin) / 1.0e6);
+
+        timer.history[timer.historyPos] = ms;
+        timer.historyPos = (timer.historyPos + 1) % GPU_TIMER_HISTORY;
+        if (timer.historyCount < GPU_TIMER_HISTORY)
+            timer.historyCount++;
+        timer.sampleCount++;
+        timer.lastMs = ms;
+
+        GpuTimerSample sample = { frame - GPU_TIMER_FRAMES, t, ms };
+        GpuTimerLog[GpuTimerLogPos] = sample; // Sobrescribir la más antigua: memoria acotada en sesiones largas
+        GpuTimerLogPos = (GpuTimerLogPos + 1) % GpuTimerLog.size();
+        if (GpuTimerLogCount < GpuTimerLog.size())
+            GpuTimerLogCount++;
+    }
+}
+
+void GpuTimerBegin(GpuTimerId id) // Timestamp de inicio del pase
+{
+    int slot = TotalFrameCount % GPU_TIMER_FRAMES;
+    glQueryCounter(GpuTimers[id].queries[slot][0], GL_TIMESTAMP);
+}
+
+void GpuTimerEnd(GpuTimerId id) // Timestamp de fin del pase
+{
+    int slot = TotalFrameCount % GPU_TIMER_FRAMES;
+    glQueryCounter(GpuTimers[id].queries[slot][1], GL_TIMESTAMP);
+    GpuTimers[id].pending[slot] = true;
+}
+
+bool GetGpuTimerStats(GpuTimerId id, float* avg, float* p95, float* p99) // Promedio y percentiles del historial
+{
+    const GpuTimer& timer = GpuTimers[id];
+    if (timer.historyCount == 0)
+        return false;
+
+    std::vector<float> sorted(timer.history, timer.history + timer.historyCount);
+    std::sort(sorted.begin(), sorted.end());
+
+    float sum = 0.0f;
+    for (size_t i = 0; i < sorted.size(); i++)
+        sum += sorted[i];
+
+    *avg = sum / sorted.size();
+    *p95 = sorted[(size_t)(0.95f * (sorted.size() - 1))];
+    *p99 = sorted[(size_t)(0.99f * (sorted.size() - 1))];
+    return true;
+}
+
+void WriteGpuTimingsCSV(const char* path) // Volcar muestras y resumen a CSV
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("ERROR: no se pudo escribir %s\n", path);
+        return;
+    }
+
+    fprintf(file, "frame,pass,ms\n");
+    size_t first = GpuTimerLogPos + GpuTimerLog.size() - GpuTimerLogCount;
+    for (size_t i = 0; i < GpuTimerLogCount; i++) // De la más antigua a la más reciente
+    {
+        const GpuTimerSample& sample = GpuTimerLog[(first + i) % GpuTimerLog.size()];
+        fprintf(file, "%u,%s,%.4f\n", sample.frame, GpuTimerNames[sample.timer], sample.ms);
+    }
+
+    fprintf(file, "\npass,avg_ms,p95_ms,p99_ms\n");
+    for (int t = 0; t < GPU_TIMER_COUNT; t++)
+    {
+        float avg, p95, p99;
+        if (GetGpuTimerStats((GpuTimerId)t, &avg, &p95, &p99))
+            fprintf(file, "%s,%.4f,%.4f,%.4f\n", GpuTimerNames[t], avg, p95, p99);
+    }
+
+    fclose(file);
+    printf("Tiempos de GPU guardados en %s (%zu muestras, %u descartadas)\n", path, GpuTimerLogCount, GpuTimerSkipped);
+}
+
+void ResetGpuTimerHistory(GpuTimerId id) // Descartar el historial (p.ej. al cambiar de variante)
+{
+    GpuTimers[id].historyCount = 0;
+    GpuTimers[id].historyPos = 0;
+}
+
+void DeleteGpuTimers() // Liberar queries
+{
+    for (int t = 0; t < GPU_TIMER_COUNT; t++)
+        for (int f = 0; f < GPU_TIMER_FRAMES; f++)
+            glDeleteQueries(2, GpuTimers[t].queries[f]);
 }
 
 // =======================================================================
-// Render Loop
+// Update Window Title with Stats
 // =======================================================================
-void RenderFunction(void) // Función de render
+void UpdateWindowTitle() // Actualizar título de la ventana con estadísticas
 {
-    FrameCount++;
-    TotalFrameCount++;
+    char title[1536];
     
-    // Calcular FPS cada 0.5 segundos
-    clock_t currentTime = clock();
-    float deltaTime = (float)(currentTime - FPSLastTime) / CLOCKS_PER_SEC;
+    // Calcular total de triángulos
+    size_t totalTriangles = (IndexCount / 3) + (GroundIndexCount / 3);
+    size_t totalVertices = IndexCount + GroundIndexCount;
     
-    if (deltaTime >= 0.5f) // Actualizar FPS cada medio segundo
+    char pacing[32];
+    if (PacingMode == PACING_VSYNC)
+        sprintf(pacing, "VSYNC");
+    else if (PacingMode == PACING_CAPPED)
+        sprintf(pacing, "CAP %.0f", FrameCapFPS);
+    else
+        sprintf(pacing, "UNCAPPED");
+
+    char lightmap[32]; // Estado del lightmap del suelo
+    if (!LightmapEnabled)
+        sprintf(lightmap, "OFF");
+    else if (ActiveBake.key != 0)
+        sprintf(lightmap, "BAKING %zu%%", ActiveBake.texels.empty() ? (size_t)0 : ActiveBake.nextTexel * (size_t)100 / ActiveBake.texels.size());
+    else if (LightmapKey == LightmapSceneKey && !DeferredShading)
     {
-        FPS = FrameCount / deltaTime;
-        FrameCount = 0;
-        FPSLastTime = currentTime;
-        
-        // Actualizar título de ventana con estadísticas
-        UpdateWindowTitle();
+        if (LightmapFromCache)
+            sprintf(lightmap, "ON (disk)");
+        else
+            sprintf(lightmap, "ON (%.0f ms)", LightmapBakeMs);
+    }
+    else
+        sprintf(lightmap, "RUNTIME"); // Proyector en movimiento o modo diferido
+
+    char idle[32]; // Estado del reposo
+    if (!IdleSkipping)
+        sprintf(idle, "OFF");
+    else if (SceneIdle)
+        sprintf(idle, "SLEEP (%u shown)", IdlePresents);
+    else if (IdleSettleFrames < IDLE_SETTLE_FRAMES)
+        sprintf(idle, "SETTLE %d", IdleSettleFrames);
+    else
+        sprintf(idle, "RUN");
+
+    char resolution[64]; // Resolución interna (clase) y escala que pide el controlador
+    if (DynamicResolution)
+        sprintf(resolution, "%.0f%% %dx%d (want %.0f%%)", 100.0f * RenderWidth / CurrentWidth,
+                RenderWidth, RenderHeight, 100.0f * RenderScaleWanted);
+    else
+        sprintf(resolution, "FIXED %dx%d", RenderWidth, RenderHeight);
+
+    // Formato: Título | FPS | Ritmo | Triángulos | Vértices | Shadow Map x cascadas | Pre-pase (ms sin / con)
+    const char* shadowUpdate = LastShadowUpdate == SHADOW_UPDATE_CACHED ? "CACHE" :
+                               LastShadowUpdate == SHADOW_UPDATE_DYNAMIC ? "DYN" : "FULL";
+    if (!ShadowCaching)
+        shadowUpdate = "NOCACHE";
+
+    char updateBudget[32]; // Triángulos de sombras locales usados / presupuesto
+    if (ShadowUpdateBudget > 0)
+        sprintf(updateBudget, "%uk/%uk", ShadowUpdateTriangles / 1000, ShadowUpdateBudget / 1000);
+    else
+        sprintf(updateBudget, "%uk/inf", ShadowUpdateTriangles / 1000);
+
+    sprintf(title, "%s | FPS: %.1f (%s) | Res: %s | Tris: %zu | Verts: %zu | Shadow: %dx%d %s x%d %s %s (9-tap %.2f / EVSM %.2f ms) | Casters: %u drawn %u culled | Spots: %zu (%u tiles, %u draws) | Points: %zu (%u faces, %u draws) | Shadow Upd: %u done %u skipped (%s tris, age %u) | Clustered: %zu lights (%u refs, max %u, %.2f ms x%u) | Rot: %s | Z-Pre: %s (%.2f / %.2f ms) | Shading: %s (fwd %.2f / def %.2f ms, GBuf %.1f MB) | Lightmap: %s | Idle: %s | Variants: %zu (%zu compiling) | Textures: %u (%u loading, %.1f MB)",
+            WINDOW_TITLE_PREFIX,
+            FPS,
+            pacing,
+            resolution,
+            totalTriangles,
+            totalVertices,
+            ShadowMapSize,
+            ShadowMapSize,
+            ShadowMapFormat == GL_DEPTH_COMPONENT16 ? "D16" : "D24",
+            ShadowCascadeCount,
+            shadowUpdate,
+            ScreenSpaceShadows ? "SS Mask" : ShadowQualityNames[ShadowQuality],
+            ShadowFilterFrameMs[SHADOW_QUALITY_PCF9],
+            ShadowFilterFrameMs[SHADOW_QUALITY_EVSM],
+            ShadowCastersDrawn,
+            ShadowCastersCulled,
+            SpotLights.size(),
+            SpotShadowInstances,
+            SpotShadowDraws,
+            PointLights.size(),
+            PointShadowFaces,
+            PointShadowDraws,
+            ShadowUpdatesDone,
+            ShadowUpdatesSkipped,
+            updateBudget,
+            ShadowUpdateMaxAge,
+            ClusterLights.size(),
+            ClusterReferences,
+            ClusterMaxLights,
+            ClusterBuildMs,
+            Jobs.ThreadCount(),
+            AutoRotate ? "AUTO" : "MANUAL",
+            DepthPrePass ? "ON" : "OFF",
+            FrameTimeMs[0],
+            FrameTimeMs[1],
+            DeferredShading ? "DEFERRED" : "FORWARD",
+            ShadingFrameMs[0],
+            ShadingFrameMs[1],
+            GBufferMemoryMB(RenderWidth, RenderHeight),
+            lightmap,
+            idle,
+            MainProgramCache.size(),
+            PendingPrograms.size(),
+            TexturesReady,
+            TexturesPending,
+            TextureMemoryBytes / (1024.0 * 1024.0));
+
+    // Tiempos de GPU por pase: promedio (p95 / p99)
+    for (int t = 0; t < GPU_TIMER_COUNT; t++)
+    {
+        float avg, p95, p99;
+        if (!GetGpuTimerStats((GpuTimerId)t, &avg, &p95, &p99))
+            continue;
+        if ((t == GPU_TIMER_DRAW_OBJ || t == GPU_TIMER_DRAW_GROUND) && !GpuTimePerDraw)
+            continue;
+        if (t == GPU_TIMER_PREPASS && !DepthPrePass)
+            continue;
+        if (t == GPU_TIMER_SHADOW_BLUR && ShadowQuality != SHADOW_QUALITY_EVSM)
+            continue;
+        if (t == GPU_TIMER_SPOT_SHADOW && SpotLights.empty())
+            continue;
+        if (t == GPU_TIMER_POINT_SHADOW && PointLights.empty())
+            continue;
+        if (t == GPU_TIMER_SHADOW_MASK && !ScreenSpaceShadows)
+            continue;
+        if ((t == GPU_TIMER_GBUFFER || t == GPU_TIMER_DEFERRED_LIGHTING) && !DeferredShading)
+            continue;
+        if (t == GPU_TIMER_UPSCALE && RenderWidth == CurrentWidth && RenderHeight == CurrentHeight)
+            continue;
+
+        size_t len = strlen(title);
+        snprintf(title + len, sizeof(title) - len, " | %s %.2f (%.2f/%.2f) ms",
+                GpuTimerNames[t], avg, p95, p99);
+    }
+    
+    glutSetWindowTitle(title);
+}
+
+// =======================================================================
+// Prototipos
+// =======================================================================
+void Initialize(int, char*[]); // Inicialización
+void InitWindow(int, char*[]); // Ventana
+void ResizeFunction(int, int); // Resize
+void RenderFunction(void); // Render
+void TimerFunction(int); // Timer
+void IdleFunction(void); // Idle
+void CleanUp(void); // Limpieza
+void CreateOBJ(void); // Crear objeto
+void DrawOBJ(void); // Dibujar objeto
+void CreateGround(void); // Crear suelo
+void DrawGround(void); // Dibujar suelo
+void KeyboardFunction(unsigned char, int, int); // Función de teclado
+void CreateShadowMap(void); // Crear mapa de sombras
+void RenderShadowPass(void); // Renderizar pase de sombras 
+void RenderShadowMoments(void); // Convertir y desenfocar momentos EVSM
+void ReleaseShadowMoments(void); // Liberar los momentos EVSM al salir de esa variante
+void AllocateShadowMaps(int, GLenum); // (Re)crear mapa y capa estática con un tamaño y formato
+bool UpdateShadowResolution(void); // Elegir resolución y formato según cobertura y presupuesto (true si realocó)
+void CreateSpotShadowAtlas(void); // Crear atlas y programa de sombras de focos
+void UpdateSpotLights(void); // Colocar focos y repartir el atlas
+void RenderSpotShadowAtlas(void); // Renderizar sombras de todos los focos
+void CreatePointShadowMaps(void); // Crear cube map array y programa de sombras puntuales
+void UpdatePointLights(void); // Colocar luces puntuales y sus caras
+void RenderPointShadowMaps(void); // Renderizar los cubos de sombra de todas las luces puntuales
+void ScheduleShadowUpdates(void); // Elegir qué sombras locales se actualizan este frame
+void CreateClusterLights(void); // Crear SSBOs del camino clustered
+void UpdateClusterLights(void); // Generar las luces sin sombra
+void BuildLightClusters(void); // Asignar luces a clusters (en paralelo) y subir los SSBOs
+void SetClusterUniforms(GLuint); // Enlazar SSBOs y parámetros de la rejilla
+void CreateDepthPrePass(void); // Crear programa del pre-pase de profundidad
+void RenderDepthPrePass(void); // Renderizar pre-pase de profundidad
+void CreateScreenShadowMask(void); // Crear programa de la máscara de sombras en pantalla
+void RenderScreenShadowMask(void); // Profundidad + máscara de sombras en pantalla
+void UpdateObjectTransform(void); // Actualizar matriz de modelo del objeto
+int AddSceneObject(const char*, GLuint, size_t, bool, bool, const float[3], const float[3]); // Registrar un objeto en la escena
+void CullShadowCasters(void); // Culling de proyectores por cascada
+void ComputeVertexBounds(const std::vector<Vertex>&, float[3], float[3]); // AABB de un conjunto de vértices
+void SetObjectTransform(int, const Matrix&); // Cambiar transformación (marca sucio si cambió)
+void SetBakeGeometry(int, const std::vector<Vertex>*, const std::vector<GLuint>*, bool); // Malla en CPU para el horneado del lightmap
+void UpdateLightmap(void); // Invalidar, leer u hornear el lightmap de los receptores estáticos
+bool LightmapActive(void); // Los receptores pueden usar el lightmap este frame
+void UpdateRenderSize(void); // Resolución interna de la clase de escala actual
+void UpdateDynamicResolution(void); // Elegir la clase de escala con el tiempo de GPU medido
+void SetRenderScaleClass(int); // Cambiar de clase de escala
+void BindMainTarget(void); // Framebuffer y viewport del pase principal
+void UpscaleMainTarget(void); // Escalar el pase principal a la ventana
+void MarkSceneDirty(void); // Un evento cambió algo: salir del reposo y volver a renderizar
+void UpdateIdleState(void); // Tras dibujar un frame: decidir si es el último hasta el próximo evento
+void PresentCachedFrame(void); // Re-presentar la copia del último frame (en reposo)
+void UpdateShadowCascades(void); // Ajustar cascadas al frustum de la cámara
+void SetShadowUniforms(GLuint); // Subir uniforms de sombras al programa principal
+void SelectMainProgram(int); // Activar una variante del programa principal
+unsigned MainShaderKey(unsigned); // Clave de la variante para el estado actual
+void InitProgramCache(void); // Clave del driver y directorio de la caché de programas
+GLuint CreateProgramCached(const char*, const ShaderStageSource*, int,
+                           std::function<void(GLuint)> = std::function<void(GLuint)>()); // Programa desde la caché en disco o en cola de compilación
+bool ProgramReady(GLuint); // El programa ya se puede usar
+bool FrameProgramsReady(void); // Los programas que usa el estado actual ya se pueden usar
+void PollShaderCompiles(void); // Terminar los programas listos (una vez por frame)
+void InitShaderCompiler(void); // Hilos de compilación del driver (si hay extensión)
+GLuint GetMainProgram(unsigned); // Programa de la variante (o el de reserva mientras compila)
+void SetMainPassProgram(GLuint); // Programa y ubicaciones de uniforms de DrawOBJ/DrawGround
+void CreateMainPrograms(void); // Compilar las variantes del estado inicial
+void RenderDeferred(void); // Pase de geometría + iluminación a pantalla completa
+void ParseCommandLine(int, char*[]); // Opciones de línea de comandos
+void SetFramePacingMode(FramePacingMode); // Cambiar modo de ritmo de frames
+void UpdateWindowTitle(void); // Actualizar título de ventana
+// =======================================================================
+// MAIN
+// =======================================================================
+int main(int argc, char* argv[]) // Función principal
+{
+    StartupTime = FrameClock::now();
+    SetTraceThreadName("Main");
+    ParseCommandLine(argc, argv); // Opciones (--vsync, --uncapped, --fps-cap N, --trace)
+    Initialize(argc, argv); // Inicialización
+    glutMainLoop(); // Bucle principal de GLUT
+    return 0;
+}
+
+// =======================================================================
+// Inicialización
+// =======================================================================
+void Initialize(int argc, char* argv[]) // Inicialización
+{
+    TRACE_SCOPE("Initialize");
+
+    InitWindow(argc, argv);
+
+    if (glewInit() != GLEW_OK)
+    {
+        std::cout << "Error inicializando GLEW\n";
+        exit(1);
+    }
+
+    printf("OpenGL Version: %s\n", glGetString(GL_VERSION));
+    InitProgramCache();
+    InitShaderCompiler();
+
+    ModelMatrix      = IDENTITY_MATRIX;
+    ProjectionMatrix = IDENTITY_MATRIX;
+    ViewMatrix       = IDENTITY_MATRIX;
+
+    // Cámara ajustada para mejor vista
+    TranslateMatrix(&ViewMatrix, -CAMERA_POSITION[0], -CAMERA_POSITION[1], -CAMERA_POSITION[2]);
+
+    // Fondo más cálido/beige como la imagen
+    glClearColor(0.82f, 0.76f, 0.65f, 1.0f);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    TextureBC1Supported = GLEW_EXT_texture_compression_s3tc != 0;
+    TextureLoader.Start(std::max(TEXTURE_LOAD_THREADS_MIN, std::thread::hardware_concurrency() / 2), "Load");
+    CreateOBJ();
+    CreateGround();
+    CreateShadowMap();
+    CreateSpotShadowAtlas();
+    CreatePointShadowMaps();
+    CreateClusterLights();
+    CreateDepthPrePass();
+    CreateScreenShadowMask();
+    CreateMainPrograms();
+    CreateGpuTimers();
+    
+    SetFramePacingMode(PacingMode);
+
+    // La compilación sigue en segundo plano; PollShaderCompiles informa cuando termina
+    printf("Arranque: %.1f ms hasta el bucle principal (%u programas de caché, %zu compilando)\n",
+           std::chrono::duration<float, std::milli>(FrameClock::now() - StartupTime).count(),
+           ProgramCacheHits, PendingPrograms.size());
+    if (PendingPrograms.empty())
+        PollShaderCompiles(); // Todo desde la caché: listo sin esperar al primer frame
+
+    // Inicializar tiempo para FPS
+    FPSLastTime = FrameClock::now();
+    LastFrameTime = FPSLastTime;
+    NextFrameTime = FPSLastTime;
+}
+
+// =======================================================================
+// Línea de comandos
+// =======================================================================
+void ParseCommandLine(int argc, char* argv[]) // Opciones de línea de comandos
+{
+    const char* traceEnv = getenv("RASTER_TRACE");
+    if (traceEnv && traceEnv[0] && strcmp(traceEnv, "0") != 0)
+        TraceEnabled.store(true);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--trace") == 0)
+            TraceEnabled.store(true);
+        else if (strcmp(argv[i], "--vsync") == 0)
+            PacingMode = PACING_VSYNC;
+        else if (strcmp(argv[i], "--uncapped") == 0)
+            PacingMode = PACING_UNCAPPED;
+        else if (strcmp(argv[i], "--shadow-size") == 0 && i + 1 < argc)
+        {
+            int size = atoi(argv[++i]);
+            ShadowFixedSize = 0;
+            if (size > 0)
+            {
+                ShadowFixedSize = SHADOW_SIZE_MIN;
+                while (ShadowFixedSize < size && ShadowFixedSize < SHADOW_SIZE_MAX)
+                    ShadowFixedSize *= 2;
+            }
+        }
+        else if (strcmp(argv[i], "--shadow-budget") == 0 && i + 1 < argc)
+        {
+            float budget = (float)atof(argv[++i]);
+            if (budget > 0.0f)
+                ShadowMemoryBudgetMB = budget;
+        }
+        else if (strcmp(argv[i], "--shadow-update-budget") == 0 && i + 1 < argc)
+        {
+            int budget = atoi(argv[++i]);
+            if (budget >= 0)
+                ShadowUpdateBudget = (unsigned)budget;
+        }
+        else if (strcmp(argv[i], "--gpu-budget") == 0 && i + 1 < argc)
+        {
+            float budget = (float)atof(argv[++i]);
+            if (budget > 0.0f)
+                GpuBudgetMs = budget;
+        }
+        else if (strcmp(argv[i], "--no-dynamic-res") == 0)
+            DynamicResolution = false;
+        else if (strcmp(argv[i], "--texture-upload-budget") == 0 && i + 1 < argc)
+        {
+            float budget = (float)atof(argv[++i]);
+            if (budget > 0.0f)
+                TextureUploadBudgetMB = budget;
+        }
+        else if (strcmp(argv[i], "--no-texture-compression") == 0)
+            TextureCompression = false;
+        else if (strcmp(argv[i], "--texture-bc7") == 0)
+            TextureForceBC7 = true;
+        else if (strcmp(argv[i], "--no-idle-skip") == 0)
+            IdleSkipping = false;
+        else if (strcmp(argv[i], "--no-shader-cache") == 0)
+            ProgramCacheEnabled = false;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            JobWorkerCount = std::max(atoi(argv[++i]) - 1, 0); // Incluye el hilo principal
+        }
+        else if (strcmp(argv[i], "--fps-cap") == 0 && i + 1 < argc)
+        {
+            float cap = (float)atof(argv[++i]);
+            if (cap > 0.0f) {
+                FrameCapFPS = cap;
+                PacingMode = PACING_CAPPED;
+            }
+        }
+    }
+}
+
+// =======================================================================
+// Frame Pacing
+// =======================================================================
+void SetSwapInterval(int interval) // Intervalo de swap (1 = vsync, 0 = sin espera)
+{
+#ifdef _WIN32
+    typedef BOOL (WINAPI *SwapIntervalProc)(int);
+    SwapIntervalProc swapInterval = (SwapIntervalProc)wglGetProcAddress("wglSwapIntervalEXT");
+#else
+    typedef int (*SwapIntervalProc)(unsigned int);
+    SwapIntervalProc swapInterval = (SwapIntervalProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalMESA");
+    if (!swapInterval)
+        swapInterval = (SwapIntervalProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalSGI");
+#endif
+    if (swapInterval)
+        swapInterval(interval);
+    else
+        printf("AVISO: intervalo de swap no disponible, vsync depende del driver\n");
+}
+
+void SetFramePacingMode(FramePacingMode mode) // Cambiar modo de ritmo de frames
+{
+    PacingMode = mode;
+    SetSwapInterval(mode == PACING_VSYNC ? 1 : 0);
+    NextFrameTime = FrameClock::now();
+
+    if (mode == PACING_VSYNC)
+        printf("Ritmo de frames: VSYNC\n");
+    else if (mode == PACING_CAPPED)
+        printf("Ritmo de frames: CAP %.0f FPS\n", FrameCapFPS);
+    else
+        printf("Ritmo de frames: SIN LIMITE (benchmark)\n");
+}
+
+// =======================================================================
+// Ventana
+// =======================================================================
+void InitWindow(int argc, char* argv[]) // Inicializa la ventana GLUT
+{
+    glutInit(&argc, argv);
+#ifdef _WIN32
+    timeBeginPeriod(1); // Sleep con precisión de 1 ms para el limitador
+#endif
+    glutInitContextVersion(4, 3);
+    glutInitContextProfile(GLUT_CORE_PROFILE);
+    glutInitWindowSize(CurrentWidth, CurrentHeight);
+    glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
+
+    WindowHandle = glutCreateWindow(WINDOW_TITLE_PREFIX);
+
+    glutReshapeFunc(ResizeFunction);
+    glutDisplayFunc(RenderFunction);
+    glutIdleFunc(IdleFunction);
+    TimerArmed = true;
+    glutTimerFunc(0, TimerFunction, 0);
+    glutCloseFunc(CleanUp);
+    glutKeyboardFunc(KeyboardFunction); // AGREGAR ESTA LÍNEA
+}
+
+// =======================================================================
+// Resize
+// =======================================================================
+void ResizeFunction(int W, int H) // Función de resize
+{
+    CurrentWidth  = W;
+    CurrentHeight = H;
+    UpdateRenderSize(); // Misma clase de escala sobre el nuevo tamaño
+    MarkSceneDirty();
+
+    glViewport(0,0,W,H);
+
+    ProjectionMatrix = CreateProjectionMatrix(
+        CAMERA_FOV,
+        (float)W / (float)H,
+        CAMERA_NEAR,
+        CAMERA_FAR
+    );
+}
+
+// =======================================================================
+// Render Loop
+// =======================================================================
+void RenderFunction(void) // Función de render
+{
+    TRACE_SCOPE("Frame");
+
+    if (SceneIdle)
+    {
+        PresentCachedFrame(); // Exposición sin cambios en la escena: no se renderiza
+        return;
+    }
+
+    FrameCount++;
+    TotalFrameCount++;
+    
+    // Tiempo real del frame (reloj de pared, no tiempo de CPU)
+    FrameClock::time_point currentTime = FrameClock::now();
+    FrameDeltaSeconds = std::chrono::duration<float>(currentTime - LastFrameTime).count();
+    if (FrameDeltaSeconds > 0.25f)
+        FrameDeltaSeconds = 0.25f; // Evitar saltos tras una pausa larga
+    LastFrameTime = currentTime;
+
+    // Programar el siguiente frame en modo CAP
+    if (PacingMode == PACING_CAPPED)
+    {
+        FrameClock::duration period = std::chrono::duration_cast<FrameClock::duration>(
+            std::chrono::duration<float>(1.0f / FrameCapFPS));
+        NextFrameTime += period;
+        if (NextFrameTime < currentTime)
+            NextFrameTime = currentTime + period; // Atrasados: no intentar recuperar frames
+    }
+
+    // Calcular FPS cada 0.5 segundos
+    float deltaTime = std::chrono::duration<float>(currentTime - FPSLastTime).count();
+    
+    if (deltaTime >= 0.5f) // Actualizar FPS cada medio segundo
+    {
+        FPS = FrameCount / deltaTime;
+        FrameTimeMs[DepthPrePass ? 1 : 0] = 1000.0f * deltaTime / FrameCount;
+        ShadowFilterFrameMs[ShadowQuality] = 1000.0f * deltaTime / FrameCount;
+        ShadingFrameMs[DeferredShading ? 1 : 0] = 1000.0f * deltaTime / FrameCount;
+        FrameCount = 0;
+        FPSLastTime = currentTime;
+        
+        // Actualizar título de ventana con estadísticas
+        UpdateWindowTitle();
+    }
+    
+    // Leer tiempos de GPU de hace GPU_TIMER_FRAMES frames (sin bloquear)
+    CollectGpuTimers(TotalFrameCount);
+    UpdateDynamicResolution();
+
+    // Programas que terminaron de compilar. Solo se espera a los que usa el
+    // estado actual: antes del primer frame se limpia la pantalla; después
+    // (p.ej. X antes de que compile el G-buffer) queda el frame anterior
+    PollShaderCompiles();
+    PumpTextureUploads();
+    if (!FrameProgramsReady())
+    {
+        if (!StartupProgramsReady)
+        {
+            glViewport(0, 0, CurrentWidth, CurrentHeight);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            TRACE_SCOPE("glutSwapBuffers");
+            glutSwapBuffers();
+        }
+        return;
+    }
+    if (!StartupProgramsReady)
+    {
+        StartupProgramsReady = true;
+        printf("Primer frame: %.1f ms desde el inicio (%zu programas siguen compilando)\n",
+               std::chrono::duration<float, std::milli>(FrameClock::now() - StartupTime).count(), PendingPrograms.size());
+    }
+
+    // Transformación del objeto compartida por todos los pases del frame
+    UpdateObjectTransform();
+    UpdateLightmap();
+    UpdateShadowCascades();
+    if (UpdateShadowResolution())
+        UpdateShadowCascades(); // Reajustar con el nuevo tamaño de texel (alineación a la rejilla)
+    BuildLightClusters();
+
+    // 1. Renderizar sombras de focos y luces puntuales elegidas por el planificador
+    //    (antes de que el pase del sol limpie los flags de cambio)
+    ScheduleShadowUpdates();
+    GpuTimerBegin(GPU_TIMER_FRAME); // Todo el trabajo de GPU del frame (controlador de resolución)
+    GpuTimerBegin(GPU_TIMER_SPOT_SHADOW);
+    RenderSpotShadowAtlas();
+    GpuTimerEnd(GPU_TIMER_SPOT_SHADOW);
+
+    GpuTimerBegin(GPU_TIMER_POINT_SHADOW);
+    RenderPointShadowMaps();
+    GpuTimerEnd(GPU_TIMER_POINT_SHADOW);
+
+    // 2. Renderizar pase de sombras del sol
+    GpuTimerBegin(GPU_TIMER_SHADOW);
+    RenderShadowPass();
+    GpuTimerEnd(GPU_TIMER_SHADOW);
+
+    if (ShadowQuality == SHADOW_QUALITY_EVSM)
+        RenderShadowMoments(); // Solo trabaja si el mapa de profundidad cambió
+    
+    // Sombra del sol resuelta una vez por píxel visible (opcional)
+    if (ScreenSpaceShadows)
+    {
+        GpuTimerBegin(GPU_TIMER_SHADOW_MASK);
+        RenderScreenShadowMask();
+        GpuTimerEnd(GPU_TIMER_SHADOW_MASK);
+    }
+
+    // 3. Renderizar escena normal (a la resolución interna)
+    BindMainTarget();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (DeferredShading)
+    {
+        GpuTimerBegin(GPU_TIMER_MAIN);
+        RenderDeferred();
+        GpuTimerEnd(GPU_TIMER_MAIN);
+    }
+    else
+    {
+        if (DepthPrePass)
+        {
+            // Solo profundidad primero; el pase principal sombrea cada píxel una vez
+            GpuTimerBegin(GPU_TIMER_PREPASS);
+            RenderDepthPrePass();
+            GpuTimerEnd(GPU_TIMER_PREPASS);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        GpuTimerBegin(GPU_TIMER_MAIN);
+
+        if (GpuTimePerDraw) GpuTimerBegin(GPU_TIMER_DRAW_OBJ);
+        DrawOBJ();
+        if (GpuTimePerDraw) GpuTimerEnd(GPU_TIMER_DRAW_OBJ);
+
+        if (GpuTimePerDraw) GpuTimerBegin(GPU_TIMER_DRAW_GROUND);
+        DrawGround();
+        if (GpuTimePerDraw) GpuTimerEnd(GPU_TIMER_DRAW_GROUND);
+
+        GpuTimerEnd(GPU_TIMER_MAIN);
+
+        if (DepthPrePass)
+        {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+    }
+
+    // 4. Escalar a la ventana si se renderizó por debajo de su resolución
+    UpscaleMainTarget();
+    GpuTimerEnd(GPU_TIMER_FRAME);
+
+    // 5. Si nada cambió durante el asentamiento, este frame se queda en pantalla
+    UpdateIdleState();
+
+    {
+        TRACE_SCOPE("glutSwapBuffers");
+        glutSwapBuffers();
+    }
+}
+
+// =======================================================================
+// Idle
+// =======================================================================
+void IdleFunction(void) // Función de idle
+{
+    if (PacingMode != PACING_CAPPED)
+    {
+        // VSYNC bloquea en glutSwapBuffers; sin límite redibuja de inmediato
+        glutPostRedisplay();
+        return;
+    }
+
+    // Limitador: dormir hasta cerca del objetivo y esperar activamente el resto
+    FrameClock::time_point now = FrameClock::now();
+    if (now < NextFrameTime)
+    {
+        float remainingMs = std::chrono::duration<float, std::milli>(NextFrameTime - now).count();
+        if (remainingMs > FRAME_SPIN_MARGIN_MS)
+        {
+            float sleepMs = remainingMs - FRAME_SPIN_MARGIN_MS;
+            if (sleepMs > FRAME_MAX_SLEEP_MS)
+                sleepMs = FRAME_MAX_SLEEP_MS;
+            std::this_thread::sleep_for(std::chrono::duration<float, std::milli>(sleepMs));
+            return; // Volver a GLUT para procesar eventos pendientes
+        }
+
+        while (FrameClock::now() < NextFrameTime)
+            std::this_thread::yield();
+    }
+
+    glutPostRedisplay();
+}
+
+// =======================================================================
+// Idle Frames
+// =======================================================================
+unsigned long long SceneActivityKey() // Hash de lo que cambia la imagen sin pasar por un evento
+{
+    unsigned long long hash = HASH_BYTES_SEED;
+    for (size_t i = 0; i < SceneObjects.size(); i++)
+        hash = HashBytes(SceneObjects[i].modelMatrix.m, sizeof(SceneObjects[i].modelMatrix.m), hash);
+    hash = HashBytes(ViewMatrix.m, sizeof(ViewMatrix.m), hash);
+    hash = HashBytes(ProjectionMatrix.m, sizeof(ProjectionMatrix.m), hash);
+    hash = HashBytes(LightDirection, sizeof(LightDirection), hash);
+    hash = HashBytes(&CurrentWidth, sizeof(CurrentWidth), hash);
+    hash = HashBytes(&CurrentHeight, sizeof(CurrentHeight), hash);
+    return hash;
+}
+
+bool SceneBusy() // Animación o trabajo repartido en frames que aún no terminó
+{
+    if (AutoRotate || (ClusterAnimate && !ClusterLights.empty()))
+        return true; // Rotación o luces clustered balanceándose
+    if (!PendingPrograms.empty() || TexturesPending > 0)
+        return true; // Programas compilando o texturas en camino
+    if (LightmapEnabled && (ActiveBake.key != 0 || LightmapKey != LightmapSceneKey))
+        return true; // Esperando estabilidad, leyendo u horneando
+    if (ShadowUpdatesSkipped > 0 || ShadowShrinkFrames > 0)
+        return true; // Sombras locales aplazadas o reducción de cascadas pendiente
+    return false;
+}
+
+void CachePresentedFrame() // Copiar el back buffer antes del swap (su contenido no se conserva)
+{
+    if (PresentCacheWidth != CurrentWidth || PresentCacheHeight != CurrentHeight)
+    {
+        if (!PresentCacheFBO)
+            glGenFramebuffers(1, &PresentCacheFBO);
+        if (PresentCacheRB)
+            glDeleteRenderbuffers(1, &PresentCacheRB);
+        glGenRenderbuffers(1, &PresentCacheRB);
+        glBindRenderbuffer(GL_RENDERBUFFER, PresentCacheRB);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, CurrentWidth, CurrentHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, PresentCacheFBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, PresentCacheRB);
+        PresentCacheWidth = CurrentWidth;
+        PresentCacheHeight = CurrentHeight;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, PresentCacheFBO);
+    glBlitFramebuffer(0, 0, CurrentWidth, CurrentHeight, 0, 0, CurrentWidth, CurrentHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void PresentCachedFrame() // Re-presentar la copia del último frame (en reposo)
+{
+    TRACE_SCOPE("PresentCachedFrame");
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, PresentCacheFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, PresentCacheWidth, PresentCacheHeight, 0, 0, CurrentWidth, CurrentHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glutSwapBuffers();
+
+    IdlePresents++;
+    UpdateWindowTitle();
+}
+
+void UpdateIdleState() // Tras dibujar un frame: decidir si es el último hasta el próximo evento
+{
+    unsigned long long key = SceneActivityKey();
+    bool changed = key != IdleSceneKey;
+    IdleSceneKey = key;
+    if (!IdleSkipping || changed || SceneBusy())
+    {
+        IdleSettleFrames = IDLE_SETTLE_FRAMES;
+        return;
+    }
+    if (--IdleSettleFrames > 0)
+        return;
+
+    // El frame de reposo se queda en pantalla: dibujarlo a resolución completa
+    // (la máscara de sombras necesita otro asentamiento tras el realojo)
+    if (DynamicResolution && RenderScaleClass < RENDER_SCALE_CLASSES - 1)
+    {
+        IdleFullResolution = true;
+        SetRenderScaleClass(RENDER_SCALE_CLASSES - 1);
+        IdleSettleFrames = IDLE_SETTLE_FRAMES;
+        return;
+    }
+
+    CachePresentedFrame();
+    SceneIdle = true;
+    IdleSleeps++;
+    IdlePresents = 0;
+    FPS = 0.0f;
+    glutIdleFunc(NULL); // Sin idle, GLUT duerme hasta el próximo evento
+    UpdateWindowTitle();
+    printf("Reposo: escena sin cambios, render detenido hasta el próximo evento\n");
+}
+
+void MarkSceneDirty() // Un evento cambió algo: salir del reposo y volver a renderizar
+{
+    IdleSettleFrames = IDLE_SETTLE_FRAMES;
+    if (IdleFullResolution)
+    {
+        IdleFullResolution = false;
+        RenderScaleCooldown = RENDER_SCALE_COOLDOWN; // Muestras del asentamiento a escala 1
+    }
+    if (!SceneIdle)
+        return;
+
+    // Reanudar sin contar el tiempo dormido como un frame lento
+    SceneIdle = false;
+    FrameClock::time_point now = FrameClock::now();
+    LastFrameTime = now;
+    FPSLastTime = now;
+    NextFrameTime = now;
+    FrameCount = 0;
+    glutIdleFunc(IdleFunction);
+    if (!TimerArmed)
+    {
+        TimerArmed = true;
+        glutTimerFunc(250, TimerFunction, 1);
+    }
+    glutPostRedisplay();
+}
+
+// =======================================================================
+// Timer
+// =======================================================================
+void TimerFunction(int Value) // Función de timer
+{
+    TimerArmed = false;
+    if (SceneIdle)
+        return; // En reposo no se re-arma: el bucle queda bloqueado en eventos
+    TimerArmed = true;
+    glutTimerFunc(250, TimerFunction, 1);
+}
+
+// =======================================================================
+// Clean
+// =======================================================================
+void CleanUp(void) // Función de limpieza
+{
+    WriteGpuTimingsCSV("gpu_timings.csv");
+    WriteTraceJSON("trace.json");
+    DeleteGpuTimers();
+    for (size_t i = 0; i < PendingPrograms.size(); i++)
+        for (size_t k = 0; k < PendingPrograms[i].shaders.size(); k++)
+            if (!PendingPrograms[i].stages[k].shared)
+                glDeleteShader(PendingPrograms[i].shaders[k]);
+    PendingPrograms.clear();
+    for (std::map<unsigned, GLuint>::iterator it = MainProgramCache.begin(); it != MainProgramCache.end(); ++it)
+        glDeleteProgram(it->second);
+    MainProgramCache.clear();
+    glDeleteShader(ShaderIds[2]);
+    glDeleteShader(ShadowShaderIds[1]);
+    glDeleteShader(ShadowShaderIds[2]);
+    glDeleteProgram(DepthPrePassProgram);
+    glDeleteProgram(ShadowBlurPrograms[0]);
+    glDeleteProgram(ShadowBlurPrograms[1]);
+    glDeleteProgram(SpotShadowProgram);
+    glDeleteProgram(PointShadowProgram);
+    glDeleteProgram(ShadowMaskProgram);
+    glDeleteTextures(1, &LightmapTex);
+    glDeleteFramebuffers(1, &SceneFBO);
+    glDeleteRenderbuffers(1, &SceneColorRB);
+    glDeleteRenderbuffers(1, &SceneDepthRB);
+    glDeleteFramebuffers(1, &PresentCacheFBO);
+    glDeleteRenderbuffers(1, &PresentCacheRB);
+    ReleaseShadowMoments();
+    glDeleteBuffers(1, &ClusterLightSSBO);
+    glDeleteBuffers(1, &ClusterRangeSSBO);
+    glDeleteBuffers(1, &ClusterIndexSSBO);
+    Jobs.Stop();
+    if (BaseColorTex != TexturePlaceholder)
+        glDeleteTextures(1, &BaseColorTex);
+    DeleteTextureLoads();
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+// =======================================================================
+void CreateOBJ() // Crear modelo OBJ
+{
+    printf("Cargando modelo OBJ...\n");
+
+    std::vector<Vertex> verts;
+    std::vector<GLuint> idx;
+
+    if (!LoadOBJ("backpack_house.obj", verts, idx))
+    {
+        printf("ERROR cargando OBJ.\n");
+        exit(1);
+    }
+
+    IndexCount = idx.size();
+
+    float boundsMin[3], boundsMax[3];
+    ComputeVertexBounds(verts, boundsMin, boundsMax);
+    HouseObjectIndex = AddSceneObject("House", 0, IndexCount, false, true, boundsMin, boundsMax);
+
+    // Los programas se crean por permutación al primer uso (GetMainProgram); el
+    // vertex shader compartido (ShaderIds[2]) solo se compila si falta alguno en la caché
+    SelectMainProgram(ShadowQuality);
+
+    
+    printf("Cargando textura en segundo plano...\n");
+    LoadTextureAsync("T_CartoonHouse_Base_color1.jpg", &BaseColorTex);  // Cambia esto por el nombre de tu textura
+
+    // Crear VAO/VBO/IBO
+    glGenVertexArrays(1, &BufferIds[0]);
+    glBindVertexArray(BufferIds[0]);
+
+    glGenBuffers(1, &BufferIds[1]);
+    glBindBuffer(GL_ARRAY_BUFFER, BufferIds[1]);
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(Vertex), verts.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
+                        sizeof(Vertex),
+                        (void*)(sizeof(float)*3));
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE,
+                    sizeof(Vertex),
+                    (void*)(sizeof(float)*6));
+
+    glGenBuffers(1, &BufferIds[2]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, BufferIds[2]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size()*sizeof(GLuint), idx.data(), GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+
+    SceneObjects[HouseObjectIndex].vao = BufferIds[0];
+
+    // Copia en CPU para trazar rayos de sombra al hornear el lightmap
+    HouseVertices.swap(verts);
+    HouseIndices.swap(idx);
+    SetBakeGeometry(HouseObjectIndex, &HouseVertices, &HouseIndices, false);
+}
+
+void SelectMainProgram(int quality) // Activar una calidad de filtro (la variante se elige por dibujo)
+{
+    ShadowQuality = quality;
+    if (quality != SHADOW_QUALITY_EVSM)
+        ReleaseShadowMoments(); // Solo cuentan en el presupuesto mientras EVSM está activo
+}
+
+unsigned MainShaderKey(unsigned features) // Clave de la variante para el estado actual
+{
+    if (features & SHADER_GBUFFER)
+        return features & (SHADER_GBUFFER | SHADER_TEXTURED); // Sin luces ni sombras
+
+    if (ScreenSpaceShadows && !(features & SHADER_LIGHTMAP))
+        features |= SHADER_SHADOW_MASK; // El filtro de cascadas no se compila
+    if (!ClusterLights.empty())
+        features |= SHADER_CLUSTERED;
+
+    unsigned quality = (features & (SHADER_SHADOW_MASK | SHADER_LIGHTMAP)) ? 0 : (unsigned)ShadowQuality;
+    return features | (quality << SHADER_QUALITY_SHIFT)
+                    | ((unsigned)SpotLights.size() << SHADER_SPOT_SHIFT)
+                    | ((unsigned)PointLights.size() << SHADER_POINT_SHIFT);
+}
+
+void BuildShaderDefines(unsigned key, char* defines, size_t size) // Bloque de #defines de una variante
+{
+    int n = snprintf(defines, size,
+                     "#define SHADOW_QUALITY %u\n#define SPOT_LIGHT_COUNT %u\n#define POINT_LIGHT_COUNT %u\n"
+                     "#define SHININESS %.1f\n#define GAMMA %.2f\n#define PCF_RADIUS %d\n",
+                     (key >> SHADER_QUALITY_SHIFT) & 0x7, (key >> SHADER_SPOT_SHIFT) & 0x7F,
+                     (key >> SHADER_POINT_SHIFT) & 0xF, MATERIAL_SHININESS, DISPLAY_GAMMA, PCF_KERNEL_RADIUS);
+
+    const unsigned flags[5] = { SHADER_TEXTURED, SHADER_SHADOW_MASK, SHADER_CLUSTERED, SHADER_DEFERRED, SHADER_LIGHTMAP };
+    const char* names[5] = { "TEXTURED", "SHADOW_MASK", "CLUSTERED", "DEFERRED_LIGHTING", "LIGHTMAPPED" };
+    for (int i = 0; i < 5 && n > 0 && (size_t)n < size; i++)
+        if (key & flags[i])
+            n += snprintf(defines + n, size - n, "#define %s\n", names[i]);
+}
+
+void CreateMainPrograms() // Pedir las variantes del estado inicial (el resto, al primer uso)
+{
+    TRACE_SCOPE("CreateMainPrograms");
+    // Forward con y sin textura: lo único que necesita el primer frame
+    const unsigned forward[2] = { SHADER_TEXTURED, 0 };
+    for (int i = 0; i < 2; i++)
+    {
+        unsigned key = MainShaderKey(forward[i]);
+        GetMainProgram(key);
+        StartupPrograms.push_back(MainProgramCache[key]);
+    }
+
+    // En segundo plano: reserva para el pase diferido y el suelo con lightmap
+    // (sin reserva: DrawGround cae a las cascadas mientras compila)
+    GetMainProgram(MainShaderKey(SHADER_GBUFFER | SHADER_TEXTURED));
+    GetMainProgram(MainShaderKey(SHADER_GBUFFER));
+    GetMainProgram(MainShaderKey(SHADER_DEFERRED));
+    GetMainProgram(MainShaderKey(SHADER_LIGHTMAP));
+}
+
+bool FrameProgramsReady() // Los programas que usa el estado actual ya se pueden usar
+{
+    // Pases auxiliares activos
+    if (!ProgramReady(ShadowShaderIds[0]))
+        return false;
+    if (ShadowQuality == SHADOW_QUALITY_EVSM && (!ProgramReady(ShadowBlurPrograms[0]) || !ProgramReady(ShadowBlurPrograms[1])))
+        return false;
+    if ((!SpotLights.empty() && !ProgramReady(SpotShadowProgram)) || (!PointLights.empty() && !ProgramReady(PointShadowProgram)))
+        return false;
+    if (ScreenSpaceShadows && !ProgramReady(ShadowMaskProgram))
+        return false;
+
+    // Variantes principales: basta con la propia o una de reserva del mismo pase
+    if (DeferredShading)
+        return GetMainProgram(MainShaderKey(SHADER_GBUFFER | SHADER_TEXTURED)) != 0 &&
+               GetMainProgram(MainShaderKey(SHADER_GBUFFER)) != 0 &&
+               GetMainProgram(MainShaderKey(SHADER_DEFERRED)) != 0;
+    if (DepthPrePass && !ProgramReady(DepthPrePassProgram))
+        return false;
+    return GetMainProgram(MainShaderKey(SHADER_TEXTURED)) != 0 && GetMainProgram(MainShaderKey(0)) != 0;
+}
+
+void SetMainProgramUnits(GLuint program) // Unidades de textura (el G-buffer usa las de la máscara de pantalla, 5–7)
+{
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "BaseColor"), 0);
+    glUniform1i(glGetUniformLocation(program, "ShadowMap"), 1);
+    glUniform1i(glGetUniformLocation(program, "ShadowMoments"), 2);
+    glUniform1i(glGetUniformLocation(program, "SpotShadowAtlas"), 3);
+    glUniform1i(glGetUniformLocation(program, "ShadowMask"), 4);
+    glUniform1i(glGetUniformLocation(program, "GBufferAlbedo"), 5);
+    glUniform1i(glGetUniformLocation(program, "GBufferNormal"), 6);
+    glUniform1i(glGetUniformLocation(program, "GBufferDepth"), 7);
+    glUniform1i(glGetUniformLocation(program, "PointShadowMaps"), 8);
+    glUniform1i(glGetUniformLocation(program, "Lightmap"), 9);
+    glUseProgram(0);
+}
+
+GLuint GetMainProgram(unsigned key) // Programa de la variante, o el último listo del mismo pase mientras compila (0 = ninguno)
+{
+    GLuint program;
+    std::map<unsigned, GLuint>::iterator it = MainProgramCache.find(key);
+    if (it != MainProgramCache.end())
+        program = it->second;
+    else
+    {
+        char defines[512];
+        BuildShaderDefines(key, defines, sizeof(defines));
+
+        // Malla: SimpleShader.vertex compartido; iluminación diferida: triángulo de pantalla completa
+        ShaderStageSource stages[2] = {
+            { GL_VERTEX_SHADER, "SimpleShader.vertex.glsl", NULL, &ShaderIds[2] },
+            { GL_FRAGMENT_SHADER, (key & SHADER_GBUFFER) ? "GBuffer.fragment.glsl" : "SimpleShader.fragment.glsl", defines, NULL }
+        };
+        if (key & SHADER_DEFERRED)
+        {
+            stages[0].file = "Fullscreen.vertex.glsl";
+            stages[0].shared = NULL;
+        }
+
+        char name[32];
+        sprintf(name, "Main 0x%06X", key);
+        program = CreateProgramCached(name, stages, 2, SetMainProgramUnits);
+        MainProgramCache[key] = program;
+    }
+
+    // Reserva por tipo de pase: forward con/sin textura (y con lightmap), G-buffer con/sin textura, iluminación diferida
+    unsigned pass = key & (SHADER_TEXTURED | SHADER_GBUFFER | SHADER_DEFERRED | SHADER_LIGHTMAP);
+    if (ProgramReady(program))
+    {
+        MainProgramFallback[pass] = program;
+        return program;
+    }
+    std::map<unsigned, GLuint>::iterator fallback = MainProgramFallback.find(pass);
+    return fallback != MainProgramFallback.end() ? fallback->second : 0;
+}
+
+void SetMainPassProgram(GLuint program) // Programa y ubicaciones de uniforms de DrawOBJ/DrawGround
+{
+    ShaderIds[0] = program;
+
+    // Obtener ubicaciones de uniforms (pueden variar entre programas)
+    ModelMatrixUniformLocation      = glGetUniformLocation(ShaderIds[0], "ModelMatrix");
+    ViewMatrixUniformLocation       = glGetUniformLocation(ShaderIds[0], "ViewMatrix");
+    ProjectionMatrixUniformLocation = glGetUniformLocation(ShaderIds[0], "ProjectionMatrix");
+
+    LightDirUniformLocation     = glGetUniformLocation(ShaderIds[0], "LightDir");
+    LightColorUniformLocation   = glGetUniformLocation(ShaderIds[0], "LightColor");
+    AmbientColorUniformLocation = glGetUniformLocation(ShaderIds[0], "AmbientColor");
+    MaterialColorUniformLocation= glGetUniformLocation(ShaderIds[0], "MaterialColor");
+    ViewPosUniformLocation      = glGetUniformLocation(ShaderIds[0], "ViewPos"); 
+}
+
+// =======================================================================
+// Program Binary Cache
+// =======================================================================
+void InitProgramCache() // Clave del driver y directorio de la caché de programas
+{
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount <= 0)
+    {
+        if (ProgramCacheEnabled)
+            printf("AVISO: el driver no ofrece formatos de binario de programa, caché desactivada\n");
+        ProgramCacheEnabled = false;
+    }
+    if (!ProgramCacheEnabled)
+        return;
+
+    // Un binario solo vale para el mismo driver: renderer, versión y formatos entran en la clave
+    std::vector<GLint> formats(formatCount);
+    glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+    ProgramCacheDriverKey = (const char*)glGetString(GL_RENDERER);
+    ProgramCacheDriverKey += "|";
+    ProgramCacheDriverKey += (const char*)glGetString(GL_VERSION);
+    for (size_t i = 0; i < formats.size(); i++)
+    {
+        char format[16];
+        sprintf(format, "|%X", (unsigned)formats[i]);
+        ProgramCacheDriverKey += format;
+    }
+
+#ifdef _WIN32
+    _mkdir(PROGRAM_CACHE_DIR);
+#else
+    mkdir(PROGRAM_CACHE_DIR, 0755);
+#endif
+    printf("Caché de programas: %s/ (%d formatos binarios)\n", PROGRAM_CACHE_DIR, formatCount);
+}
+
+bool LoadProgramBinary(GLuint program, const char* path) // Cargar un binario de la caché (false = no está o se rechazó)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    // Cabecera: magia, formato binario, longitud
+    unsigned header[3] = {0};
+    std::vector<char> binary;
+    bool valid = fread(header, sizeof(header), 1, file) == 1 && header[0] == PROGRAM_CACHE_MAGIC && header[2] > 0;
+    if (valid)
+    {
+        binary.resize(header[2]);
+        valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+
+    GLint linked = GL_FALSE;
+    if (valid)
+    {
+        glProgramBinary(program, (GLenum)header[1], binary.data(), (GLsizei)binary.size());
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    }
+    if (!linked)
+    {
+        // Truncado o rechazado (driver actualizado, formato distinto): borrar y recompilar
+        remove(path);
+        ProgramCacheEvictions++;
+        printf("AVISO: binario %s rechazado, se recompila\n", path);
+        return false;
+    }
+    return true;
+}
+
+void SaveProgramBinary(GLuint program, const char* path) // Guardar el binario de un programa enlazado
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return;
+    unsigned header[3] = { PROGRAM_CACHE_MAGIC, (unsigned)format, (unsigned)length };
+    bool written = fwrite(header, sizeof(header), 1, file) == 1 &&
+                   fwrite(binary.data(), 1, length, file) == (size_t)length;
+    fclose(file);
+    if (!written)
+        remove(path); // No dejar binarios a medias
+}
+
+unsigned long long ProgramSourceHash(const ShaderStageSource* stages, int count) // Clave de la caché: driver + etapas
+{
+    // Driver + (tipo, archivo, defines, código) de cada etapa
+    unsigned long long hash = HashBytes(ProgramCacheDriverKey.data(), ProgramCacheDriverKey.size(), HASH_BYTES_SEED);
+    for (int i = 0; i < count; i++)
+    {
+        std::ifstream file(stages[i].file, std::ios::binary);
+        std::stringstream source;
+        source << file.rdbuf();
+        std::string text = source.str();
+        const char* defines = stages[i].defines ? stages[i].defines : "";
+
+        hash = HashBytes(&stages[i].type, sizeof(stages[i].type), hash);
+        hash = HashBytes(stages[i].file, strlen(stages[i].file) + 1, hash);
+        hash = HashBytes(defines, strlen(defines) + 1, hash);
+        hash = HashBytes(text.data(), text.size(), hash);
+    }
+    return hash;
+}
+
+// =======================================================================
+// Shader Compilation Service
+// =======================================================================
+// Los programas se piden con CreateProgramCached y se devuelven al momento.
+// Con KHR_parallel_shader_compile todos se compilan y enlazan a la vez en
+// hilos del driver y se sondea GL_COMPLETION_STATUS una vez por frame; sin la
+// extensión se construyen de uno en uno dentro de SHADER_COMPILE_BUDGET_MS por
+// frame. Al terminar se comprueba cada etapa con su log completo, se guarda el
+// binario y se llama a onReady (unidades de textura, ubicaciones)
+void InitShaderCompiler() // Hilos de compilación del driver (si hay extensión)
+{
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu); // Tantos como el driver quiera
+    else if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+    ParallelShaderCompile = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+    printf("Compilación de shaders: %s\n", ParallelShaderCompile ? "paralela (KHR_parallel_shader_compile)" :
+                                                                  "por frames (sin KHR_parallel_shader_compile)");
+}
+
+void StartProgramBuild(PendingProgram& pending) // Compilar etapas y pedir el enlace (no bloquea con la extensión)
+{
+    TRACE_SCOPE("StartProgramBuild");
+    for (size_t i = 0; i < pending.stages.size(); i++)
+    {
+        const PendingStage& stage = pending.stages[i];
+        const char* defines = stage.defines.empty() ? NULL : stage.defines.c_str();
+        GLuint shader;
+        if (stage.shared)
+        {
+            if (!*stage.shared)
+                *stage.shared = LoadShaderWithDefines(stage.file.c_str(), stage.type, defines);
+            shader = *stage.shared;
+        }
+        else
+            shader = LoadShaderWithDefines(stage.file.c_str(), stage.type, defines);
+        pending.shaders.push_back(shader);
+        glAttachShader(pending.program, shader);
+    }
+
+    if (ProgramCacheEnabled)
+        glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pending.program);
+    pending.started = true;
+}
+
+void FinishProgramBuild(PendingProgram& pending) // Comprobar etapas y enlace, guardar binario y avisar
+{
+    TRACE_SCOPE("FinishProgramBuild");
+    bool compiled = true;
+    for (size_t i = 0; i < pending.stages.size(); i++)
+    {
+        char stageName[160];
+        sprintf(stageName, "%s (%s)", pending.name.c_str(), pending.stages[i].file.c_str());
+        compiled = CheckShaderCompile(pending.shaders[i], stageName) && compiled;
+
+        if (pending.stages[i].shared)
+            glDetachShader(pending.program, pending.shaders[i]);
+        else
+            glDeleteShader(pending.shaders[i]);
+    }
+
+    bool linked = CheckProgramLink(pending.program, pending.name.c_str()) != 0;
+    if (compiled && linked && ProgramCacheEnabled)
+        SaveProgramBinary(pending.program, pending.path.c_str());
+    if (!compiled || !linked)
+        ShaderCompileErrors++;
+
+    ProgramCacheMisses++;
+    if (pending.onReady)
+        pending.onReady(pending.program);
+
+    float ms = std::chrono::duration<float, std::milli>(FrameClock::now() - pending.submitted).count();
+    printf("Programa %s: compilado, listo %.1f ms tras pedirlo\n", pending.name.c_str(), ms);
+}
+
+GLuint CreateProgramCached(const char* name, const ShaderStageSource* stages, int count,
+                           std::function<void(GLuint)> onReady) // Programa desde la caché en disco o en cola de compilación
+{
+    TRACE_SCOPE("CreateProgram");
+    FrameClock::time_point start = FrameClock::now();
+
+    char path[256] = "";
+    if (ProgramCacheEnabled)
+        sprintf(path, "%s/%016llx.bin", PROGRAM_CACHE_DIR, ProgramSourceHash(stages, count));
+
+    GLuint program = glCreateProgram();
+    if (ProgramCacheEnabled && LoadProgramBinary(program, path))
+    {
+        // Binario aceptado: listo sin compilar
+        ProgramCacheHits++;
+        if (onReady)
+            onReady(program);
+        float ms = std::chrono::duration<float, std::milli>(FrameClock::now() - start).count();
+        ProgramBuildMs += ms;
+        printf("Programa %s: caché en %.1f ms\n", name, ms);
+        return program;
+    }
+
+    // Un intento fallido de glProgramBinary deja el programa sin enlazar: empezar de cero
+    glDeleteProgram(program);
+
+    PendingProgram pending;
+    pending.program = glCreateProgram();
+    pending.name = name;
+    pending.path = path;
+    for (int i = 0; i < count; i++)
+    {
+        PendingStage stage;
+        stage.type = stages[i].type;
+        stage.file = stages[i].file;
+        stage.defines = stages[i].defines ? stages[i].defines : "";
+        stage.shared = stages[i].shared;
+        pending.stages.push_back(stage);
+    }
+    pending.onReady = onReady;
+    pending.submitted = start;
+    pending.started = false;
+
+    if (ParallelShaderCompile)
+        StartProgramBuild(pending); // El driver compila en segundo plano
+    PendingPrograms.push_back(pending);
+
+    ProgramBuildMs += std::chrono::duration<float, std::milli>(FrameClock::now() - start).count();
+    return pending.program;
+}
+
+bool ProgramReady(GLuint program) // El programa ya se puede usar
+{
+    for (size_t i = 0; i < PendingPrograms.size(); i++)
+        if (PendingPrograms[i].program == program)
+            return false;
+    return program != 0;
+}
+
+void PollShaderCompiles() // Terminar los programas listos (una vez por frame)
+{
+    if (PendingPrograms.empty() && ProgramsSummaryPrinted)
+        return;
+
+    TRACE_SCOPE("PollShaderCompiles");
+    FrameClock::time_point start = FrameClock::now();
+
+    // Sin extensión se construye en orden: primero lo que necesita el primer frame
+    if (!ParallelShaderCompile && !StartupProgramsReady)
+        std::stable_partition(PendingPrograms.begin(), PendingPrograms.end(), [](const PendingProgram& pending) {
+            return std::find(StartupPrograms.begin(), StartupPrograms.end(), pending.program) != StartupPrograms.end();
+        });
+    int built = 0; // Programas terminados en esta llamada
+    for (size_t i = 0; i < PendingPrograms.size(); )
+    {
+        PendingProgram& pending = PendingPrograms[i];
+        if (ParallelShaderCompile)
+        {
+            GLint done = GL_FALSE;
+            glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+            {
+                i++;
+                continue;
+            }
+        }
+
+        FrameClock::time_point buildStart = FrameClock::now();
+        if (!ParallelShaderCompile)
+        {
+            // Sin extensión el enlace bloquea: al menos uno por frame, el resto si queda presupuesto
+            float elapsedMs = std::chrono::duration<float, std::milli>(buildStart - start).count();
+            if (built > 0 && elapsedMs > SHADER_COMPILE_BUDGET_MS)
+                break;
+            StartProgramBuild(pending);
+        }
+
+        FinishProgramBuild(pending);
+        ProgramBuildMs += std::chrono::duration<float, std::milli>(FrameClock::now() - buildStart).count();
+        PendingPrograms.erase(PendingPrograms.begin() + i);
+        built++;
+    }
+
+    if (PendingPrograms.empty() && !ProgramsSummaryPrinted)
+    {
+        // Arranque en frío (todo compilado) o en caliente (todo desde la caché)
+        ProgramsSummaryPrinted = true;
+        const char* cacheState = !ProgramCacheEnabled ? "desactivada" :
+                                 ProgramCacheMisses == 0 ? "caliente" :
+                                 ProgramCacheHits == 0 ? "fría" : "parcial";
+        printf("Programas listos: %.1f ms desde el inicio, %.1f ms en el hilo principal (%u de caché, %u compilados, %u descartados, %u errores; caché %s)\n",
+               std::chrono::duration<float, std::milli>(FrameClock::now() - StartupTime).count(), ProgramBuildMs,
+               ProgramCacheHits, ProgramCacheMisses, ProgramCacheEvictions, ShaderCompileErrors, cacheState);
+    }
+}
+
+// =======================================================================
+// Create Shadow Map
+// =======================================================================
+void CreateShadowMap() // Crear mapa de sombras
+{
+    TRACE_SCOPE("CreateShadowMap");
+
+    // Crear shader de sombras (el fragment shader vacío lo comparten los demás pases de profundidad)
+    const ShaderStageSource shadowStages[2] = {
+        { GL_FRAGMENT_SHADER, "Shadow.fragment.glsl", NULL, &ShadowShaderIds[1] },
+        { GL_VERTEX_SHADER, "Shadow.vertex.glsl", NULL, &ShadowShaderIds[2] }
+    };
+    ShadowShaderIds[0] = CreateProgramCached("Shadow", shadowStages, 2);
+    StartupPrograms.push_back(ShadowShaderIds[0]);
+
+    // Crear framebuffers para sombras (mapa y capa estática)
+    glGenFramebuffers(1, &ShadowFBO);
+    glGenFramebuffers(1, &ShadowStaticFBO);
+
+    // Mapa y capa estática: tamaño inicial; UpdateShadowResolution lo adapta
+    AllocateShadowMaps(ShadowFixedSize ? ShadowFixedSize : 1024, GL_DEPTH_COMPONENT24);
+
+    // El mapa de profundidad tiene comparación activada; el compute lo lee crudo
+    glGenSamplers(1, &ShadowDepthSampler);
+    glSamplerParameteri(ShadowDepthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glSamplerParameteri(ShadowDepthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glSamplerParameteri(ShadowDepthSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const ShaderStageSource blurStage = { GL_COMPUTE_SHADER, "ShadowBlur.compute.glsl",
+                                              pass == 0 ? "#define BLUR_FROM_DEPTH\n" : NULL, NULL };
+        ShadowBlurPrograms[pass] = CreateProgramCached(pass == 0 ? "Shadow blur (depth)" : "Shadow blur", &blurStage, 1,
+            [](GLuint program) {
+                glUseProgram(program);
+                glUniform1i(glGetUniformLocation(program, "ShadowDepth"), 0); // Solo existe en la primera pasada
+                glUseProgram(0);
+            });
+    }
+    
+    // Vista de la luz derivada de LightDirection: mira desde la luz hacia el origen.
+    // La distancia es irrelevante para una proyección ortográfica; los planos
+    // cercano/lejano de cada cascada se ajustan en UpdateShadowCascades
+    float len = sqrtf(LightDirection[0] * LightDirection[0] +
+                      LightDirection[1] * LightDirection[1] +
+                      LightDirection[2] * LightDirection[2]);
+    float eye[3] = { LightDirection[0] / len, LightDirection[1] / len, LightDirection[2] / len };
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    float up[3] = { 0.0f, 1.0f, 0.0f };
+    if (fabsf(eye[1]) > 0.99f) {
+        up[1] = 0.0f; up[2] = 1.0f; // Luz casi vertical: evitar up paralelo
+    }
+    LightViewMatrix = CreateLookAtMatrix(eye, center, up);
+    
+    printf("Shadow mapping creado: %d cascadas\n", ShadowCascadeCount);
+}
+
+float ShadowMapMemoryMB(int size, GLenum format) // Memoria de mapa + capa estática (+ momentos si EVSM)
+{
+    float layerTexels = (float)size * size * MAX_SHADOW_CASCADES;
+    float depthBytes = format == GL_DEPTH_COMPONENT16 ? 2.0f : 4.0f; // D24 ocupa 4 bytes en la práctica
+    float bytes = layerTexels * depthBytes * 2.0f;
+    if (ShadowQuality == SHADOW_QUALITY_EVSM)
+        bytes += layerTexels * 16.0f * (4.0f / 3.0f + 1.0f); // Momentos con mipmaps + temporal
+    return bytes / (1024.0f * 1024.0f);
+}
+
+void AllocateShadowMaps(int size, GLenum format) // (Re)crear mapa y capa estática con un tamaño y formato
+{
+    TRACE_SCOPE("AllocateShadowMaps");
+
+    glDeleteTextures(1, &ShadowMap);
+    glDeleteTextures(1, &ShadowStaticMap);
+
+    // Array de texturas de profundidad (una capa por cascada)
+    glGenTextures(1, &ShadowMap);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowMap);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format,
+                size, size, MAX_SHADOW_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Comparación por hardware: con GL_LINEAR cada lectura es un PCF bilineal
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    // Adjuntar la primera capa al framebuffer (cada cascada cambia la capa)
+    glBindFramebuffer(GL_FRAMEBUFFER, ShadowFBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ShadowMap, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    // Verificar que el framebuffer esté completo
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("ERROR: Shadow framebuffer no está completo!\n");
+    }
+
+    // Capa estática: misma forma y formato que el mapa (glCopyImageSubData), solo proyectores estáticos
+    glGenTextures(1, &ShadowStaticMap);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowStaticMap);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format,
+                size, size, MAX_SHADOW_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, ShadowStaticFBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ShadowStaticMap, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    ShadowMapSize = size;
+    ShadowMapFormat = format;
+    ShadowCacheValid = false;
+    ShadowMomentsValid = false;
+    ShadowShrinkFrames = 0;
+
+    printf("Shadow map: %dx%d %s x%d (%.1f MB)\n", size, size,
+           format == GL_DEPTH_COMPONENT16 ? "D16" : "D24", MAX_SHADOW_CASCADES, ShadowMapMemoryMB(size, format));
+}
+
+void AllocateShadowMoments() // Reservar momentos EVSM al tamaño del mapa actual
+{
+    glDeleteTextures(1, &ShadowMoments);
+    glDeleteTextures(1, &ShadowMomentsTemp);
+
+    // EVSM: momentos en RGBA32F (los exponentes grandes no caben en 16F) con
+    // mipmaps completos; se leen una vez por fragmento con filtrado trilineal
+    int momentLevels = 1;
+    while ((ShadowMapSize >> momentLevels) > 0)
+        momentLevels++;
+
+    glGenTextures(1, &ShadowMoments);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowMoments);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, momentLevels, GL_RGBA32F, ShadowMapSize, ShadowMapSize, MAX_SHADOW_CASCADES);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenTextures(1, &ShadowMomentsTemp);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowMomentsTemp);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA32F, ShadowMapSize, ShadowMapSize, MAX_SHADOW_CASCADES);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    ShadowMomentsSize = ShadowMapSize;
+    ShadowMomentsValid = false;
+}
+
+void ReleaseShadowMoments() // Liberar los momentos EVSM (se vuelven a reservar al usar la variante)
+{
+    if (!ShadowMoments)
+        return;
+    glDeleteTextures(1, &ShadowMoments);
+    glDeleteTextures(1, &ShadowMomentsTemp);
+    ShadowMoments = 0;
+    ShadowMomentsTemp = 0;
+    ShadowMomentsSize = 0;
+    ShadowMomentsValid = false;
+}
+
+bool UpdateShadowResolution() // Elegir resolución y formato según cobertura en pantalla y presupuesto
+{
+    // Texels necesarios por cascada: lado cubierto / tamaño de un píxel de
+    // pantalla a la profundidad media del corte
+    float tanHalfFov = tanf(DegreesToRadians(CAMERA_FOV) * 0.5f);
+    float wantedTexels = 0.0f;
+    for (int c = 0; c < ShadowCascadeCount; c++)
+    {
+        float pixelWorld = 2.0f * CascadeSliceDepths[c] * tanHalfFov / (float)RenderHeight;
+        wantedTexels = fmaxf(wantedTexels, ShadowTexelsPerPixel * CascadeExtents[c] / pixelWorld);
+    }
+
+    int size = SHADOW_SIZE_MIN;
+    while (size < wantedTexels && size < SHADOW_SIZE_MAX)
+        size *= 2;
+    if (ShadowFixedSize)
+        size = ShadowFixedSize;
+
+    // La proyección ortográfica es lineal: un paso de D16 equivale a
+    // rango / 65535 unidades de mundo, y glPolygonOffset empuja la profundidad
+    // ShadowConstantBias pasos. D16 basta si ese empuje queda por debajo de
+    // una fracción del texel en todas las cascadas (el término por pendiente
+    // ya es del orden de un texel); si no, D24 evita el peter panning
+    GLenum format = GL_DEPTH_COMPONENT16;
+    for (int c = 0; c < ShadowCascadeCount; c++)
+    {
+        float biasWorld = ShadowConstantBias * CascadeDepthRanges[c] / 65535.0f;
+        float texelWorld = CascadeExtents[c] / size;
+        if (biasWorld > ShadowDepthTexelFraction * texelWorld)
+            format = GL_DEPTH_COMPONENT24;
+    }
+
+    // Presupuesto de memoria: bajar en potencias de dos hasta que quepa
+    while (size > SHADOW_SIZE_MIN && ShadowMapMemoryMB(size, format) > ShadowMemoryBudgetMB)
+        size /= 2;
+
+    // Crecer, ganar precisión o salir del presupuesto: de inmediato. Reducir:
+    // solo si se sigue pidiendo menos durante SHADOW_SHRINK_FRAMES
+    bool upgrade = size > ShadowMapSize ||
+                   (format == GL_DEPTH_COMPONENT24 && ShadowMapFormat == GL_DEPTH_COMPONENT16) ||
+                   ShadowMapMemoryMB(ShadowMapSize, ShadowMapFormat) > ShadowMemoryBudgetMB;
+    bool downgrade = size < ShadowMapSize || format != ShadowMapFormat;
+
+    if (upgrade)
+    {
+        AllocateShadowMaps(size, format);
+        return true;
+    }
+    if (downgrade)
+    {
+        if (++ShadowShrinkFrames >= SHADOW_SHRINK_FRAMES)
+        {
+            AllocateShadowMaps(size, format);
+            return true;
+        }
+    }
+    else
+        ShadowShrinkFrames = 0;
+    return false;
+}
+
+// =======================================================================
+// Update Shadow Cascades
+// =======================================================================
+void UpdateShadowCascades() // Ajustar cascadas al frustum de la cámara y a la escena (cada frame)
+{
+    // Esquema práctico: mezcla de reparto logarítmico y uniforme
+    float nearPlane = CAMERA_NEAR;
+    float farPlane = ShadowDistance;
+    float splits[MAX_SHADOW_CASCADES + 1];
+    splits[0] = nearPlane;
+    for (int i = 1; i <= ShadowCascadeCount; i++)
+    {
+        float t = (float)i / ShadowCascadeCount;
+        float logSplit = nearPlane * powf(farPlane / nearPlane, t);
+        float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+        splits[i] = CascadeSplitLambda * logSplit + (1.0f - CascadeSplitLambda) * uniformSplit;
+    }
+
+    // Cajas en espacio de la luz de los receptores visibles y de los proyectores
+    Matrix viewProjection = MultiplyMatrices(&ViewMatrix, &ProjectionMatrix);
+    float frustumPlanes[6][4];
+    ExtractFrustumPlanes(&viewProjection, frustumPlanes);
+
+    std::vector<float> casterBoxes; // minX, minY, minZ, maxX, maxY, maxZ por proyector
+    float recvMin[3] = { 1e30f, 1e30f, 1e30f };
+    float recvMax[3] = { -1e30f, -1e30f, -1e30f };
+
+    for (size_t i = 0; i < SceneObjects.size(); i++)
+    {
+        SceneObject& obj = SceneObjects[i];
+        TransformAABB(&LightViewMatrix, obj.worldMin, obj.worldMax, obj.lightMin, obj.lightMax);
+
+        if (obj.castsShadows)
+        {
+            casterBoxes.insert(casterBoxes.end(), obj.lightMin, obj.lightMin + 3);
+            casterBoxes.insert(casterBoxes.end(), obj.lightMax, obj.lightMax + 3);
+        }
+
+        if (AABBIntersectsFrustum(frustumPlanes, obj.worldMin, obj.worldMax))
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                recvMin[k] = fminf(recvMin[k], obj.lightMin[k]);
+                recvMax[k] = fmaxf(recvMax[k], obj.lightMax[k]);
+            }
+        }
+    }
+    ShadowReceiverMinZ = recvMin[2];
+
+    Matrix inverseView = InvertMatrix(&ViewMatrix);
+    float tanHalfFov = tanf(DegreesToRadians(CAMERA_FOV) * 0.5f);
+    float aspect = (float)CurrentWidth / (float)CurrentHeight;
+
+    for (int c = 0; c < ShadowCascadeCount; c++)
+    {
+        // Esquinas del corte del frustum en espacio de la luz
+        float minX = 1e30f, minY = 1e30f, minZ = 1e30f;
+        float maxX = -1e30f, maxY = -1e30f, maxZ = -1e30f;
+
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float depth = (corner < 4) ? splits[c] : splits[c + 1];
+            float halfH = depth * tanHalfFov;
+            float halfW = halfH * aspect;
+            float viewPos[3] = {
+                (corner & 1) ? halfW : -halfW,
+                (corner & 2) ? halfH : -halfH,
+                -depth
+            };
+
+            float worldPos[3], lightPos[3];
+            TransformPoint(&inverseView, viewPos, worldPos);
+            TransformPoint(&LightViewMatrix, worldPos, lightPos);
+
+            minX = fminf(minX, lightPos[0]); maxX = fmaxf(maxX, lightPos[0]);
+            minY = fminf(minY, lightPos[1]); maxY = fmaxf(maxY, lightPos[1]);
+            minZ = fminf(minZ, lightPos[2]); maxZ = fmaxf(maxZ, lightPos[2]);
+        }
+
+        // Recortar al volumen ocupado por receptores visibles (si hay alguno en el corte)
+        if (recvMin[0] < maxX && recvMax[0] > minX && recvMin[1] < maxY && recvMax[1] > minY &&
+            recvMin[2] < maxZ && recvMax[2] > minZ)
+        {
+            minX = fmaxf(minX, recvMin[0]); maxX = fminf(maxX, recvMax[0]);
+            minY = fmaxf(minY, recvMin[1]); maxY = fminf(maxY, recvMax[1]);
+            minZ = fmaxf(minZ, recvMin[2]); maxZ = fminf(maxZ, recvMax[2]);
+        }
+
+        // El plano cercano debe incluir cualquier proyector que cubra el recorte
+        // en XY, aunque esté fuera del corte (entre la luz y los receptores)
+        float casterMaxZ = maxZ;
+        for (size_t b = 0; b < casterBoxes.size(); b += 6)
+        {
+            const float* box = &casterBoxes[b];
+            if (box[0] < maxX && box[3] > minX && box[1] < maxY && box[4] > minY)
+                casterMaxZ = fmaxf(casterMaxZ, box[5]);
+        }
+
+        // Ajuste de texel: tamaño cuadrado redondeado a ShadowExtentQuantum y
+        // origen alineado a la rejilla de texels, para que los bordes de las
+        // sombras no tiemblen cuando el ajuste cambia de un frame a otro
+        float extent = fmaxf(maxX - minX, maxY - minY);
+        extent = ceilf(extent / ShadowExtentQuantum) * ShadowExtentQuantum;
+        float texel = extent / ShadowMapSize;
+        float left = floorf((0.5f * (minX + maxX) - 0.5f * extent) / texel) * texel;
+        float bottom = floorf((0.5f * (minY + maxY) - 0.5f * extent) / texel) * texel;
+
+        // La vista de la luz mira hacia -Z: near = -maxZ, far = -minZ
+        float lightNear = floorf(-casterMaxZ / ShadowDepthQuantum) * ShadowDepthQuantum;
+        float lightFar = ceilf(-minZ / ShadowDepthQuantum) * ShadowDepthQuantum;
+        if (lightFar <= lightNear)
+            lightFar = lightNear + ShadowDepthQuantum;
+
+        Matrix projection = CreateOrthographicMatrix(left, left + extent, bottom, bottom + extent,
+                                                     lightNear, lightFar);
+
+        // MultiplyMatrices(a, b) aplica a y después b
+        CascadeMatrices[c] = MultiplyMatrices(&LightViewMatrix, &projection);
+        CascadeSplits[c] = splits[c + 1];
+        CascadeExtents[c] = extent;
+        CascadeDepthRanges[c] = lightFar - lightNear;
+        CascadeSliceDepths[c] = 0.5f * (splits[c] + splits[c + 1]);
+    }
+}
+
+// =======================================================================
+// Shadow Uniforms
+// =======================================================================
+void SetShadowUniforms(GLuint program) // Subir cascadas, luz y shadow map al programa principal
+{
+    glUniformMatrix4fv(glGetUniformLocation(program, "CascadeMatrices"), ShadowCascadeCount, GL_FALSE, CascadeMatrices[0].m);
+    glUniform1fv(glGetUniformLocation(program, "CascadeSplits"), ShadowCascadeCount, CascadeSplits);
+    glUniform1i(glGetUniformLocation(program, "CascadeCount"), ShadowCascadeCount);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowMap);
+
+    if (ShadowQuality == SHADOW_QUALITY_EVSM)
+    {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowMoments);
+        glUniform2fv(glGetUniformLocation(program, "EvsmExponents"), 1, EvsmExponents);
+        glUniform1f(glGetUniformLocation(program, "EvsmBleedReduction"), EvsmBleedReduction);
+        glUniform1f(glGetUniformLocation(program, "EvsmVarianceBias"), EvsmVarianceBias);
+    }
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, SpotShadowAtlas);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, SpotLightUBO);
+
+    glActiveTexture(GL_TEXTURE8);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, PointShadowMaps);
+    if (!PointLights.empty())
+    {
+        glUniform4fv(glGetUniformLocation(program, "PointLightPositionRange"), (GLsizei)PointLights.size(), PointLightPositionRange);
+        glUniform3fv(glGetUniformLocation(program, "PointLightColor"), (GLsizei)PointLights.size(), PointLightColors);
+    }
+
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, ShadowMaskTex[ShadowMaskIndex]);
+
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform3f(glGetUniformLocation(program, "LightDir"), LightDirection[0], LightDirection[1], LightDirection[2]);
+}
+
+// =======================================================================
+// Render Shadow Pass
+// =======================================================================
+void CullShadowCasters() // Culling de proyectores por cascada (AABB vs. luz y volumen de sombra vs. cámara)
+{
+    TRACE_SCOPE("CullShadowCasters");
+
+    // Frustum de la cámara expresado en espacio de la luz: el volumen de
+    // sombra de un proyector es su caja de luz alargada hacia -Z
+    Matrix viewProjection = MultiplyMatrices(&ViewMatrix, &ProjectionMatrix);
+    Matrix inverseLightView = InvertMatrix(&LightViewMatrix);
+    Matrix lightToClip = MultiplyMatrices(&inverseLightView, &viewProjection);
+    float cameraPlanes[6][4];
+    ExtractFrustumPlanes(&lightToClip, cameraPlanes);
+
+    float cascadePlanes[MAX_SHADOW_CASCADES][6][4];
+    for (int c = 0; c < ShadowCascadeCount; c++)
+        ExtractFrustumPlanes(&CascadeMatrices[c], cascadePlanes[c]);
+
+    for (size_t i = 0; i < SceneObjects.size(); i++)
+    {
+        SceneObject& obj = SceneObjects[i];
+        obj.shadowCascadeMask = 0;
+        if (!obj.castsShadows)
+            continue;
+
+        if (!ShadowCasterCulling)
+        {
+            obj.shadowCascadeMask = ~0u;
+            continue;
+        }
+
+        // La sombra no llega más allá del receptor visible más lejano
+        float sweptMin[3] = { obj.lightMin[0], obj.lightMin[1], fminf(obj.lightMin[2], ShadowReceiverMinZ) };
+        if (!AABBIntersectsFrustum(cameraPlanes, sweptMin, obj.lightMax))
+            continue;
+
+        for (int c = 0; c < ShadowCascadeCount; c++)
+        {
+            if (AABBIntersectsFrustum(cascadePlanes[c], obj.worldMin, obj.worldMax))
+                obj.shadowCascadeMask |= 1u << c;
+        }
+    }
+}
+
+void DrawShadowCasters(bool staticCasters, int cascade, GLint modelLoc) // Dibujar los proyectores estáticos o los dinámicos de una cascada
+{
+    for (size_t i = 0; i < SceneObjects.size(); i++)
+    {
+        const SceneObject& obj = SceneObjects[i];
+        if (obj.isStatic != staticCasters || !obj.castsShadows)
+            continue;
+
+        if (!(obj.shadowCascadeMask & (1u << cascade)))
+        {
+            ShadowCastersCulled++;
+            continue;
+        }
+        ShadowCastersDrawn++;
+
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, obj.modelMatrix.m);
+        glBindVertexArray(obj.vao);
+        glDrawElements(GL_TRIANGLES, (GLsizei)obj.indexCount, GL_UNSIGNED_INT, 0);
+    }
+}
+
+void RenderShadowPass() // Renderizar pase de sombras
+{
+    TRACE_SCOPE("RenderShadowPass");
+
+    // ¿Qué cambió desde la última actualización? La vista de la luz y el
+    // ajuste de las cascadas están contenidos en CascadeMatrices
+    bool lightChanged = !ShadowCacheValid ||
+                        ShadowCachedCascadeCount != ShadowCascadeCount ||
+                        memcmp(ShadowCachedCascades, CascadeMatrices, sizeof(Matrix) * ShadowCascadeCount) != 0;
+    bool staticDirty = lightChanged || !ShadowCaching;
+    bool dynamicDirty = staticDirty;
+
+    for (size_t i = 0; i < SceneObjects.size(); i++)
+    {
+        if (!SceneObjects[i].transformDirty)
+            continue;
+        if (SceneObjects[i].isStatic)
+            staticDirty = true;
+        dynamicDirty = true;
+    }
+
+    if (!dynamicDirty)
+    {
+        LastShadowUpdate = SHADOW_UPDATE_CACHED; // Nada cambió: el mapa sigue siendo válido
+        return;
+    }
+    LastShadowUpdate = staticDirty ? SHADOW_UPDATE_FULL : SHADOW_UPDATE_DYNAMIC;
+
+    CullShadowCasters();
+    ShadowCastersDrawn = 0;
+    ShadowCastersCulled = 0;
+
+    glViewport(0, 0, ShadowMapSize, ShadowMapSize);
+    
+    // Habilitar culling para evitar peter panning
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT); // Renderizar caras traseras para sombras
+    
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    // Bias por pendiente: la comparación por hardware usa la profundidad del
+    // texel sin interpolar, así que las superficies inclinadas necesitan offset
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(ShadowSlopeBias, ShadowConstantBias);
+    
+    glUseProgram(ShadowShaderIds[0]);
+    
+    GLint lightSpaceLoc = glGetUniformLocation(ShadowShaderIds[0], "LightSpaceMatrix");
+    GLint modelLoc = glGetUniformLocation(ShadowShaderIds[0], "ModelMatrix");
+    
+    if (lightSpaceLoc == -1 || modelLoc == -1) {
+        printf("ERROR: No se encontraron uniforms en shadow shader\n");
+    }
+
+    for (int c = 0; c < ShadowCascadeCount; c++)
+    {
+        glUniformMatrix4fv(lightSpaceLoc, 1, GL_FALSE, CascadeMatrices[c].m);
+
+        if (!ShadowCaching)
+        {
+            // Sin caché: todos los proyectores directamente en el mapa
+            glBindFramebuffer(GL_FRAMEBUFFER, ShadowFBO);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ShadowMap, 0, c);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            DrawShadowCasters(true, c, modelLoc);
+            DrawShadowCasters(false, c, modelLoc);
+            continue;
+        }
+
+        // Capa estática: solo cuando cambia la luz o un proyector estático
+        if (staticDirty)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, ShadowStaticFBO);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ShadowStaticMap, 0, c);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            DrawShadowCasters(true, c, modelLoc);
+        }
+
+        // Mapa final = copia de la capa estática + proyectores dinámicos
+        glCopyImageSubData(ShadowStaticMap, GL_TEXTURE_2D_ARRAY, 0, 0, 0, c,
+                           ShadowMap, GL_TEXTURE_2D_ARRAY, 0, 0, 0, c,
+                           ShadowMapSize, ShadowMapSize, 1);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, ShadowFBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ShadowMap, 0, c);
+        DrawShadowCasters(false, c, modelLoc);
+    }
+    
+    glBindVertexArray(0);
+    glUseProgram(0);
+    
+    // Restaurar culling y offset
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    
+    // Restaurar viewport
+    glViewport(0, 0, CurrentWidth, CurrentHeight);
+
+    // Marcar el mapa como válido para estas matrices
+    for (size_t i = 0; i < SceneObjects.size(); i++)
+        SceneObjects[i].transformDirty = false;
+    memcpy(ShadowCachedCascades, CascadeMatrices, sizeof(Matrix) * ShadowCascadeCount);
+    ShadowCachedCascadeCount = ShadowCascadeCount;
+    ShadowCacheValid = true;
+}
+
+// =======================================================================
+// EVSM: momentos desenfocados
+// =======================================================================
+void RenderShadowMoments() // Profundidad -> momentos, blur separable en compute y mipmaps
+{
+    if (ShadowMomentsValid && ShadowMomentsSize == ShadowMapSize && LastShadowUpdate == SHADOW_UPDATE_CACHED)
+        return; // El mapa de profundidad no cambió: los momentos siguen valiendo
+
+    TRACE_SCOPE("RenderShadowMoments");
+
+    if (ShadowMomentsSize != ShadowMapSize)
+        AllocateShadowMoments();
+
+    GpuTimerBegin(GPU_TIMER_SHADOW_BLUR);
+
+    GLuint groupsX = (ShadowMapSize + 15) / 16;
+    GLuint groupsY = (ShadowMapSize + 15) / 16;
+
+    // Pasada X: lee la profundidad (sin comparación) y escribe momentos en el temporal
+    glUseProgram(ShadowBlurPrograms[0]);
+    glUniform2fv(glGetUniformLocation(ShadowBlurPrograms[0], "EvsmExponents"), 1, EvsmExponents);
+    glUniform2i(glGetUniformLocation(ShadowBlurPrograms[0], "Direction"), 1, 0);
+    glUniform1i(glGetUniformLocation(ShadowBlurPrograms[0], "BlurRadius"), EvsmBlurRadius);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowMap);
+    glBindSampler(0, ShadowDepthSampler);
+    glBindImageTexture(1, ShadowMomentsTemp, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glDispatchCompute(groupsX, groupsY, ShadowCascadeCount);
+    glBindSampler(0, 0);
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    // Pasada Y: temporal -> nivel 0 de los momentos
+    glUseProgram(ShadowBlurPrograms[1]);
+    glUniform2i(glGetUniformLocation(ShadowBlurPrograms[1], "Direction"), 0, 1);
+    glUniform1i(glGetUniformLocation(ShadowBlurPrograms[1], "BlurRadius"), EvsmBlurRadius);
+    glBindImageTexture(0, ShadowMomentsTemp, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(1, ShadowMoments, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glDispatchCompute(groupsX, groupsY, ShadowCascadeCount);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowMoments);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glUseProgram(0);
+
+    GpuTimerEnd(GPU_TIMER_SHADOW_BLUR);
+    ShadowMomentsValid = true;
+}
+
+// =======================================================================
+// Spot Light Shadow Atlas
+// =======================================================================
+void CreateSpotShadowAtlas() // Crear atlas y programa de sombras de focos
+{
+    TRACE_SCOPE("CreateSpotShadowAtlas");
+
+    // Con ARB_shader_viewport_layer_array el vertex shader elige el viewport
+    // (tile) por instancia: un draw por objeto cubre hasta SpotBatchSize focos
+    GLint maxViewports = 1;
+    glGetIntegerv(GL_MAX_VIEWPORTS, &maxViewports);
+    SpotViewportArray = GLEW_ARB_shader_viewport_layer_array && maxViewports > 1;
+    SpotBatchSize = SpotViewportArray ? std::min(maxViewports, SPOT_BATCH_MAX) : 1;
+
+    const ShaderStageSource spotStages[2] = {
+        { GL_VERTEX_SHADER, "ShadowAtlas.vertex.glsl", SpotViewportArray ? "#define USE_VIEWPORT_INDEX\n" : NULL, NULL },
+        { GL_FRAGMENT_SHADER, "Shadow.fragment.glsl", NULL, &ShadowShaderIds[1] } // Fragment shader vacío del pase de sombras
+    };
+    SpotShadowProgram = CreateProgramCached("Spot shadow", spotStages, 2, [](GLuint program) {
+        SpotBatchSlotsLoc  = glGetUniformLocation(program, "BatchSlots");
+        SpotSlotLightsLoc  = glGetUniformLocation(program, "SlotLights");
+        SpotModelLoc       = glGetUniformLocation(program, "ModelMatrix");
+    });
+
+    // Atlas de profundidad con comparación por hardware
+    glGenTextures(1, &SpotShadowAtlas);
+    glBindTexture(GL_TEXTURE_2D, SpotShadowAtlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SPOT_ATLAS_SIZE, SPOT_ATLAS_SIZE, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &SpotShadowFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, SpotShadowFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, SpotShadowAtlas, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        printf("ERROR: Spot shadow framebuffer no está completo!\n");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(1, &SpotLightUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, SpotLightUBO);
+    glBufferData(GL_UNIFORM_BUFFER, MAX_SPOT_LIGHTS * sizeof(SpotLightGPU), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    UpdateSpotLights();
+
+    printf("Atlas de sombras de focos: %dx%d, %s (%d focos por draw)\n", SPOT_ATLAS_SIZE, SPOT_ATLAS_SIZE,
+           SpotViewportArray ? "gl_ViewportIndex" : "un pase por foco", SpotBatchSize);
+}
+
+bool CompareSpotResolution(int a, int b) // Orden de empaquetado: tiles grandes primero
+{
+    return SpotLights[a].resolution > SpotLights[b].resolution;
+}
+
+void UpdateSpotLights() // Colocar focos alrededor del objeto y repartir el atlas
+{
+    SpotLights.resize(SpotLightCount);
+
+    float intensity = SpotLightCount > 0 ? 3.0f / sqrtf((float)SpotLightCount) : 0.0f;
+
+    for (int i = 0; i < SpotLightCount; i++)
+    {
+        SpotLight& light = SpotLights[i];
+
+        // Anillo de focos apuntando al objeto, con alturas y colores variados
+        float angle = 2.0f * (float)PI * (i + 0.5f) / SpotLightCount;
+        float radius = 4.0f + 1.5f * (i % 3);
+        light.position[0] = radius * cosf(angle);
+        light.position[1] = 3.0f + 0.75f * (i % 4);
+        light.position[2] = radius * sinf(angle);
+        light.target[0] = 0.0f;
+        light.target[1] = -1.0f;
+        light.target[2] = 0.0f;
+
+        float hue = (float)i / SpotLightCount * 6.0f;
+        light.color[0] = intensity * (0.6f + 0.4f * cosf(hue));
+        light.color[1] = intensity * (0.6f + 0.4f * cosf(hue - 2.094f));
+        light.color[2] = intensity * (0.6f + 0.4f * cosf(hue + 2.094f));
+        light.range = 15.0f;
+        light.outerAngle = 35.0f;
+        light.innerAngle = 25.0f;
+
+        // Resolución según la distancia a la cámara (1024 hasta 4 unidades, la mitad cada vez que se duplica)
+        float dx = light.position[0] - CAMERA_POSITION[0];
+        float dy = light.position[1] - CAMERA_POSITION[1];
+        float dz = light.position[2] - CAMERA_POSITION[2];
+        float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+        int halvings = (int)floorf(log2f(fmaxf(distance / 4.0f, 1.0f)));
+        light.resolution = std::max(SPOT_TILE_MAX >> halvings, SPOT_TILE_MIN);
+
+        float up[3] = { 0.0f, 1.0f, 0.0f };
+        Matrix view = CreateLookAtMatrix(light.position, light.target, up);
+        Matrix projection = CreateProjectionMatrix(2.0f * light.outerAngle, 1.0f, 0.1f, light.range);
+        light.matrix = MultiplyMatrices(&view, &projection);
+        light.shadow.valid = false; // El tile puede haber cambiado: hay que renderizarlo
+        light.shadow.dirty = true;
+        light.shadow.scheduled = false;
+        light.shadow.updatedFrame = TotalFrameCount;
+    }
+
+    // Empaquetado por estantes con tiles potencia de dos de mayor a menor. Si
+    // no caben, se reducen todas las resoluciones a la mitad y se reintenta
+    std::vector<int> order(SpotLightCount);
+    for (int i = 0; i < SpotLightCount; i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), CompareSpotResolution);
+
+    bool packed = false;
+    while (!packed)
+    {
+        int x = 0, y = 0, shelfHeight = 0;
+        packed = true;
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            SpotLight& light = SpotLights[order[k]];
+            if (x + light.resolution > SPOT_ATLAS_SIZE)
+            {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            if (y + light.resolution > SPOT_ATLAS_SIZE)
+            {
+                packed = false;
+                break;
+            }
+            light.atlasX = x;
+            light.atlasY = y;
+            x += light.resolution;
+            shelfHeight = std::max(shelfHeight, light.resolution);
+        }
+
+        if (!packed)
+            for (int i = 0; i < SpotLightCount; i++)
+                SpotLights[i].resolution = std::max(SpotLights[i].resolution / 2, 1);
+    }
+
+    // Subir al UBO
+    std::vector<SpotLightGPU> gpuLights(SpotLightCount);
+    for (int i = 0; i < SpotLightCount; i++)
+    {
+        const SpotLight& light = SpotLights[i];
+        SpotLightGPU& gpu = gpuLights[i];
+
+        float dir[3] = { light.target[0] - light.position[0],
+                         light.target[1] - light.position[1],
+                         light.target[2] - light.position[2] };
+        float len = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+
+        memcpy(gpu.matrix, light.matrix.m, sizeof(gpu.matrix));
+        gpu.positionRange[0] = light.position[0];
+        gpu.positionRange[1] = light.position[1];
+        gpu.positionRange[2] = light.position[2];
+        gpu.positionRange[3] = light.range;
+        gpu.directionCos[0] = dir[0] / len;
+        gpu.directionCos[1] = dir[1] / len;
+        gpu.directionCos[2] = dir[2] / len;
+        gpu.directionCos[3] = cosf(DegreesToRadians(light.outerAngle));
+        gpu.color[0] = light.color[0];
+        gpu.color[1] = light.color[1];
+        gpu.color[2] = light.color[2];
+        gpu.color[3] = cosf(DegreesToRadians(light.innerAngle));
+        gpu.atlasRect[0] = (float)light.atlasX / SPOT_ATLAS_SIZE;
+        gpu.atlasRect[1] = (float)light.atlasY / SPOT_ATLAS_SIZE;
+        gpu.atlasRect[2] = (float)light.resolution / SPOT_ATLAS_SIZE;
+        gpu.atlasRect[3] = (float)light.resolution / SPOT_ATLAS_SIZE;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, SpotLightUBO);
+    if (SpotLightCount > 0)
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, SpotLightCount * sizeof(SpotLightGPU), gpuLights.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void RenderSpotShadowAtlas() // Renderizar en el atlas las sombras de los focos elegidos
+{
+    // Focos que el planificador eligió este frame; el resto conserva su tile
+    std::vector<int> scheduled;
+    for (size_t l = 0; l < SpotLights.size(); l++)
+        if (SpotLights[l].shadow.scheduled)
+            scheduled.push_back((int)l);
+    if (scheduled.empty())
+        return;
+
+    TRACE_SCOPE("RenderSpotShadowAtlas");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, SpotShadowFBO);
+
+    // Limpiar solo los tiles que se van a redibujar
+    glEnable(GL_SCISSOR_TEST);
+    for (size_t k = 0; k < scheduled.size(); k++)
+    {
+        const SpotLight& light = SpotLights[scheduled[k]];
+        glScissor(light.atlasX, light.atlasY, light.resolution, light.resolution);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+    glDisable(GL_SCISSOR_TEST);
+
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(ShadowSlopeBias, ShadowConstantBias);
+
+    glUseProgram(SpotShadowProgram);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, SpotLightUBO);
+
+    SpotShadowDraws = 0;
+    SpotShadowInstances = 0;
+
+    // Planos de cada foco para descartar proyectores fuera de su cono
+    std::vector<float> lightPlanes(SpotLights.size() * 24);
+    for (size_t k = 0; k < scheduled.size(); k++)
+        ExtractFrustumPlanes(&SpotLights[scheduled[k]].matrix, (float(*)[4])&lightPlanes[scheduled[k] * 24]);
+
+    // Lotes de SpotBatchSize focos: un viewport (slot) por foco, un draw instanciado por objeto
+    for (size_t base = 0; base < scheduled.size(); base += SpotBatchSize)
+    {
+        size_t batchEnd = std::min(base + SpotBatchSize, scheduled.size());
+
+        GLint slotLights[SPOT_BATCH_MAX];
+        for (size_t k = base; k < batchEnd; k++)
+            slotLights[k - base] = scheduled[k];
+        glUniform1iv(SpotSlotLightsLoc, (GLsizei)(batchEnd - base), slotLights);
+
+        if (SpotViewportArray)
+        {
+            float viewports[SPOT_BATCH_MAX * 4];
+            for (size_t k = base; k < batchEnd; k++)
+            {
+                const SpotLight& light = SpotLights[scheduled[k]];
+                float* v = &viewports[(k - base) * 4];
+                v[0] = (float)light.atlasX;
+                v[1] = (float)light.atlasY;
+                v[2] = v[3] = (float)light.resolution;
+            }
+            glViewportArrayv(0, (GLsizei)(batchEnd - base), viewports);
+        }
+        else
+        {
+            const SpotLight& light = SpotLights[scheduled[base]];
+            glViewport(light.atlasX, light.atlasY, light.resolution, light.resolution);
+        }
+
+        for (size_t i = 0; i < SceneObjects.size(); i++)
+        {
+            const SceneObject& obj = SceneObjects[i];
+            if (!obj.castsShadows)
+                continue;
+
+            // Instancias = slots del lote cuyo frustum contiene al objeto
+            GLint batchSlots[SPOT_BATCH_MAX];
+            GLsizei instances = 0;
+            for (size_t k = base; k < batchEnd; k++)
+            {
+                if (AABBIntersectsFrustum((float(*)[4])&lightPlanes[scheduled[k] * 24], obj.worldMin, obj.worldMax))
+                    batchSlots[instances++] = (GLint)(k - base);
+            }
+            if (instances == 0)
+                continue;
+
+            glUniform1iv(SpotBatchSlotsLoc, instances, batchSlots);
+            glUniformMatrix4fv(SpotModelLoc, 1, GL_FALSE, obj.modelMatrix.m);
+            glBindVertexArray(obj.vao);
+            glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)obj.indexCount, GL_UNSIGNED_INT, 0, instances);
+
+            SpotShadowDraws++;
+            SpotShadowInstances += instances;
+        }
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, CurrentWidth, CurrentHeight); // También restablece todo el array de viewports
+
+    for (size_t k = 0; k < scheduled.size(); k++)
+    {
+        ShadowUpdateState& state = SpotLights[scheduled[k]].shadow;
+        state.valid = true;
+        state.dirty = false;
+        state.scheduled = false;
+        state.updatedFrame = TotalFrameCount;
+    }
+}
+
+// =======================================================================
+// Point Light Cube Shadows
+// =======================================================================
+void CreatePointShadowMaps() // Crear cube map array y programa de sombras puntuales
+{
+    TRACE_SCOPE("CreatePointShadowMaps");
+
+    // Con ARB_shader_viewport_layer_array el vertex shader elige la capa (cara)
+    // por instancia: un draw por objeto y luz cubre todas sus caras visibles
+    PointVertexLayer = GLEW_ARB_shader_viewport_layer_array;
+
+    const ShaderStageSource pointStages[2] = {
+        { GL_VERTEX_SHADER, "PointShadow.vertex.glsl", PointVertexLayer ? "#define USE_VERTEX_LAYER\n" : NULL, NULL },
+        { GL_FRAGMENT_SHADER, "Shadow.fragment.glsl", NULL, &ShadowShaderIds[1] } // Fragment shader vacío del pase de sombras
+    };
+    PointShadowProgram = CreateProgramCached("Point shadow", pointStages, 2, [](GLuint program) {
+        PointFacesLoc        = glGetUniformLocation(program, "Faces");
+        PointFaceMatricesLoc = glGetUniformLocation(program, "FaceMatrices");
+        PointLayerLoc        = glGetUniformLocation(program, "LightLayer");
+        PointModelLoc        = glGetUniformLocation(program, "ModelMatrix");
+    });
+
+    // Profundidad de todos los cubos con comparación por hardware (samplerCubeArrayShadow)
+    glGenTextures(1, &PointShadowMaps);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, PointShadowMaps);
+    glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT24, POINT_SHADOW_SIZE, POINT_SHADOW_SIZE,
+                 6 * MAX_POINT_LIGHTS, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+    // Attachment por capas: glClear limpia todas las caras de una vez
+    glGenFramebuffers(1, &PointShadowFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, PointShadowFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, PointShadowMaps, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        printf("ERROR: Point shadow framebuffer no está completo!\n");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    UpdatePointLights();
+
+    printf("Sombras puntuales: %d cubos de %dx%d, %s\n", MAX_POINT_LIGHTS, POINT_SHADOW_SIZE, POINT_SHADOW_SIZE,
+           PointVertexLayer ? "gl_Layer (un pase por luz)" : "un pase por cara");
+}
+
+void UpdatePointLights() // Colocar farolas alrededor del objeto y calcular sus caras
+{
+    // Ejes y vectores "up" de las caras en el orden de capas del cube map
+    static const float faceDirs[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    static const float faceUps[6][3]  = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+    PointLights.resize(PointLightCount);
+    float intensity = PointLightCount > 0 ? 2.0f / sqrtf((float)PointLightCount) : 0.0f;
+
+    for (int i = 0; i < PointLightCount; i++)
+    {
+        PointLight& light = PointLights[i];
+
+        // Farolas en anillo, entre los focos, con luz cálida
+        float angle = 2.0f * (float)PI * i / PointLightCount + 0.3f;
+        light.position[0] = 3.5f * cosf(angle);
+        light.position[1] = 1.0f;
+        light.position[2] = 3.5f * sinf(angle);
+        light.color[0] = intensity * 1.0f;
+        light.color[1] = intensity * 0.75f;
+        light.color[2] = intensity * 0.45f;
+        light.range = 8.0f;
+
+        // Caras de 90 grados: el lejano es el alcance, así la profundidad cubre toda la luz
+        Matrix projection = CreateProjectionMatrix(90.0f, 1.0f, POINT_SHADOW_NEAR, light.range);
+        for (int f = 0; f < 6; f++)
+        {
+            float target[3] = { light.position[0] + faceDirs[f][0],
+                                light.position[1] + faceDirs[f][1],
+                                light.position[2] + faceDirs[f][2] };
+            Matrix view = CreateLookAtMatrix(light.position, target, faceUps[f]);
+            light.faceMatrices[f] = MultiplyMatrices(&view, &projection);
+        }
+
+        PointLightPositionRange[i * 4 + 0] = light.position[0];
+        PointLightPositionRange[i * 4 + 1] = light.position[1];
+        PointLightPositionRange[i * 4 + 2] = light.position[2];
+        PointLightPositionRange[i * 4 + 3] = light.range;
+        PointLightColors[i * 3 + 0] = light.color[0];
+        PointLightColors[i * 3 + 1] = light.color[1];
+        PointLightColors[i * 3 + 2] = light.color[2];
+
+        light.shadow.valid = false;
+        light.shadow.dirty = true;
+        light.shadow.scheduled = false;
+        light.shadow.updatedFrame = TotalFrameCount;
+    }
+}
+
+void RenderPointShadowMaps() // Renderizar los cubos elegidos: un draw instanciado por luz y objeto
+{
+    // Luces que el planificador eligió este frame; el resto conserva su cubo
+    std::vector<int> scheduled;
+    for (size_t l = 0; l < PointLights.size(); l++)
+        if (PointLights[l].shadow.scheduled)
+            scheduled.push_back((int)l);
+    if (scheduled.empty())
+        return;
+
+    TRACE_SCOPE("RenderPointShadowMaps");
+
+    // Limpiar solo las seis caras de cada luz elegida
+    glBindFramebuffer(GL_FRAMEBUFFER, PointShadowFBO);
+    glViewport(0, 0, POINT_SHADOW_SIZE, POINT_SHADOW_SIZE);
+    for (size_t k = 0; k < scheduled.size(); k++)
+    {
+        for (int f = 0; f < 6; f++)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, PointShadowMaps, 0, scheduled[k] * 6 + f);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+    }
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, PointShadowMaps, 0);
+
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(ShadowSlopeBias, ShadowConstantBias);
+
+    glUseProgram(PointShadowProgram);
+
+    PointShadowDraws = 0;
+    PointShadowFaces = 0;
+
+    for (size_t k = 0; k < scheduled.size(); k++)
+    {
+        int l = scheduled[k];
+        const PointLight& light = PointLights[l];
+        glUniformMatrix4fv(PointFaceMatricesLoc, 6, GL_FALSE, light.faceMatrices[0].m);
+        glUniform1i(PointLayerLoc, (GLint)(l * 6));
+
+        float facePlanes[6][6][4];
+        for (int f = 0; f < 6; f++)
+            ExtractFrustumPlanes(&light.faceMatrices[f], facePlanes[f]);
+
+        for (size_t i = 0; i < SceneObjects.size(); i++)
+        {
+            const SceneObject& obj = SceneObjects[i];
+            if (!obj.castsShadows)
+                continue;
+
+            // Instancias = caras cuyo frustum contiene al objeto
+            GLint faces[6];
+            GLsizei instances = 0;
+            for (int f = 0; f < 6; f++)
+            {
+                if (AABBIntersectsFrustum(facePlanes[f], obj.worldMin, obj.worldMax))
+                    faces[instances++] = f;
+            }
+            if (instances == 0)
+                continue;
+
+            glUniformMatrix4fv(PointModelLoc, 1, GL_FALSE, obj.modelMatrix.m);
+            glBindVertexArray(obj.vao);
+
+            if (PointVertexLayer)
+            {
+                glUniform1iv(PointFacesLoc, instances, faces);
+                glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)obj.indexCount, GL_UNSIGNED_INT, 0, instances);
+                PointShadowDraws++;
+            }
+            else
+            {
+                // Sin gl_Layer en el vertex shader: una cara por pase, enlazando su capa
+                for (GLsizei n = 0; n < instances; n++)
+                {
+                    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, PointShadowMaps, 0, l * 6 + faces[n]);
+                    glUniform1i(PointFacesLoc, faces[n]);
+                    glDrawElements(GL_TRIANGLES, (GLsizei)obj.indexCount, GL_UNSIGNED_INT, 0);
+                    PointShadowDraws++;
+                }
+            }
+            PointShadowFaces += instances;
+        }
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, CurrentWidth, CurrentHeight);
+
+    for (size_t k = 0; k < scheduled.size(); k++)
+    {
+        ShadowUpdateState& state = PointLights[scheduled[k]].shadow;
+        state.valid = true;
+        state.dirty = false;
+        state.scheduled = false;
+        state.updatedFrame = TotalFrameCount;
+    }
+}
+
+// =======================================================================
+// Shadow Update Scheduler
+// =======================================================================
+struct ShadowUpdateCandidate // Luz con sombra pendiente de actualizar
+{
+    ShadowUpdateState* state;
+    float priority;
+};
+
+bool CompareShadowPriority(const ShadowUpdateCandidate& a, const ShadowUpdateCandidate& b) // Mayor prioridad primero
+{
+    return a.priority > b.priority;
+}
+
+float ShadowUpdatePriority(const float position[3], float range, const ShadowUpdateState& state,
+                           const float cameraPlanes[6][4]) // Importancia en pantalla * antigüedad
+{
+    // Importancia: tamaño aparente de su zona de influencia, mucho menor si no se ve
+    float dx = position[0] - CAMERA_POSITION[0];
+    float dy = position[1] - CAMERA_POSITION[1];
+    float dz = position[2] - CAMERA_POSITION[2];
+    float importance = range / fmaxf(sqrtf(dx * dx + dy * dy + dz * dz), 1.0f);
+
+    float sphereMin[3] = { position[0] - range, position[1] - range, position[2] - range };
+    float sphereMax[3] = { position[0] + range, position[1] + range, position[2] + range };
+    if (!AABBIntersectsFrustum(cameraPlanes, sphereMin, sphereMax))
+        importance *= 0.1f;
+
+    // Antigüedad: cada SHADOW_UPDATE_AGE_FRAMES de espera suma otra vez la importancia
+    unsigned age = TotalFrameCount - state.updatedFrame;
+    return importance * (1.0f + age / SHADOW_UPDATE_AGE_FRAMES);
+}
+
+void ScheduleShadowUpdates() // Elegir qué sombras de focos y luces puntuales se actualizan este frame
+{
+    TRACE_SCOPE("ScheduleShadowUpdates");
+
+    Matrix viewProjection = MultiplyMatrices(&ViewMatrix, &ProjectionMatrix);
+    float cameraPlanes[6][4];
+    ExtractFrustumPlanes(&viewProjection, cameraPlanes);
+
+    std::vector<ShadowUpdateCandidate> candidates;
+
+    // Focos: sucios si un proyector entra, sale o se mueve dentro de su frustum
+    for (size_t l = 0; l < SpotLights.size(); l++)
+    {
+        SpotLight& light = SpotLights[l];
+        float planes[6][4];
+        ExtractFrustumPlanes(&light.matrix, planes);
+
+        light.shadow.cost = 0;
+        for (size_t i = 0; i < SceneObjects.size(); i++)
+        {
+            const SceneObject& obj = SceneObjects[i];
+            if (!obj.castsShadows)
+                continue;
+            bool inside = AABBIntersectsFrustum(planes, obj.worldMin, obj.worldMax) != 0;
+            if (inside)
+                light.shadow.cost += (unsigned)(obj.indexCount / 3);
+            if (obj.transformDirty && (inside || AABBIntersectsFrustum(planes, obj.prevWorldMin, obj.prevWorldMax)))
+                light.shadow.dirty = true;
+        }
+
+        if (light.shadow.dirty)
+        {
+            ShadowUpdateCandidate candidate = { &light.shadow, ShadowUpdatePriority(light.position, light.range, light.shadow, cameraPlanes) };
+            candidates.push_back(candidate);
+        }
+    }
+
+    // Luces puntuales: sucias si un proyector toca su esfera; el coste cuenta cada cara que lo ve
+    for (size_t l = 0; l < PointLights.size(); l++)
+    {
+        PointLight& light = PointLights[l];
+        float facePlanes[6][6][4];
+        for (int f = 0; f < 6; f++)
+            ExtractFrustumPlanes(&light.faceMatrices[f], facePlanes[f]);
+
+        light.shadow.cost = 0;
+        for (size_t i = 0; i < SceneObjects.size(); i++)
+        {
+            const SceneObject& obj = SceneObjects[i];
+            if (!obj.castsShadows)
+                continue;
+            for (int f = 0; f < 6; f++)
+                if (AABBIntersectsFrustum(facePlanes[f], obj.worldMin, obj.worldMax))
+                    light.shadow.cost += (unsigned)(obj.indexCount / 3);
+            if (obj.transformDirty &&
+                (SphereIntersectsAABB(light.position, light.range, obj.worldMin, obj.worldMax) ||
+                 SphereIntersectsAABB(light.position, light.range, obj.prevWorldMin, obj.prevWorldMax)))
+                light.shadow.dirty = true;
+        }
+
+        if (light.shadow.dirty)
+        {
+            ShadowUpdateCandidate candidate = { &light.shadow, ShadowUpdatePriority(light.position, light.range, light.shadow, cameraPlanes) };
+            candidates.push_back(candidate);
+        }
+    }
+
+    // Reparto voraz por prioridad. Siempre entra al menos una luz (progreso
+    // garantizado) y las que nunca se renderizaron no esperan: un mapa viejo
+    // es aceptable, uno vacío o de otra luz no
+    std::sort(candidates.begin(), candidates.end(), CompareShadowPriority);
+
+    ShadowUpdatesDone = 0;
+    ShadowUpdatesSkipped = 0;
+    ShadowUpdateTriangles = 0;
+    ShadowUpdateMaxAge = 0;
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        ShadowUpdateState& state = *candidates[c].state;
+        bool fits = ShadowUpdateBudget == 0 || ShadowUpdatesDone == 0 || !state.valid ||
+                    ShadowUpdateTriangles + state.cost <= ShadowUpdateBudget;
+        if (fits)
+        {
+            state.scheduled = true;
+            ShadowUpdatesDone++;
+            ShadowUpdateTriangles += state.cost;
+        }
+        else
+        {
+            ShadowUpdatesSkipped++;
+            ShadowUpdateMaxAge = std::max(ShadowUpdateMaxAge, TotalFrameCount - state.updatedFrame);
+        }
+    }
+}
+
+// =======================================================================
+// Clustered Lights
+// =======================================================================
+// Rejilla de CLUSTER_X x CLUSTER_Y tiles de pantalla por CLUSTER_Z cortes
+// exponenciales de profundidad. Cada frame se asigna cada luz a los clusters
+// que toca su esfera y el fragment shader recorre solo la lista de su cluster.
+void CreateClusterLights() // Crear SSBOs y workers del camino clustered
+{
+    unsigned workers = JobWorkerCount >= 0 ? (unsigned)JobWorkerCount
+                                           : std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    Jobs.Start(workers);
+
+    glGenBuffers(1, &ClusterLightSSBO);
+    glGenBuffers(1, &ClusterRangeSSBO);
+    glGenBuffers(1, &ClusterIndexSSBO);
+
+    UpdateClusterLights();
+
+    printf("Luces clustered: rejilla %dx%dx%d, %u hilos\n", CLUSTER_X, CLUSTER_Y, CLUSTER_Z, Jobs.ThreadCount());
+}
+
+float ClusterRandom(unsigned& state) // Pseudoaleatorio reproducible en [0, 1)
+{
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) / 16777216.0f;
+}
+
+void UpdateClusterLights() // Repartir luces pequeñas sobre el suelo (farolillos y focos hacia abajo)
+{
+    ClusterLights.resize(ClusterLightCount);
+    ClusterLightData.resize(ClusterLightCount);
+    ClusterBounds.resize(ClusterLightCount);
+
+    unsigned seed = 12345u;
+    float intensity = ClusterLightCount > 0 ? 1.5f / sqrtf(ClusterLightCount / 64.0f + 1.0f) : 0.0f;
+    for (int i = 0; i < ClusterLightCount; i++)
+    {
+        ClusterLight& light = ClusterLights[i];
+        light.basePosition[0] = -9.5f + 19.0f * ClusterRandom(seed);
+        light.basePosition[1] = -1.3f + 1.8f * ClusterRandom(seed);
+        light.basePosition[2] = -9.5f + 19.0f * ClusterRandom(seed);
+        memcpy(light.position, light.basePosition, sizeof(light.position));
+        light.range = 1.0f + 1.5f * ClusterRandom(seed);
+
+        float hue = ClusterRandom(seed) * 6.2832f;
+        light.color[0] = intensity * (0.6f + 0.4f * cosf(hue));
+        light.color[1] = intensity * (0.6f + 0.4f * cosf(hue - 2.094f));
+        light.color[2] = intensity * (0.6f + 0.4f * cosf(hue + 2.094f));
+
+        // Uno de cada cuatro es un foco apuntando al suelo
+        light.direction[0] = 0.0f;
+        light.direction[1] = -1.0f;
+        light.direction[2] = 0.0f;
+        bool spot = (i % 4) == 0;
+        light.cosOuter = spot ? cosf(DegreesToRadians(40.0f)) : -2.0f;
+        light.cosInner = spot ? cosf(DegreesToRadians(28.0f)) : -2.0f;
+        light.phase = ClusterRandom(seed) * 6.2832f;
+    }
+}
+
+int ClusterSlice(float depth, float depthScale) // Corte de profundidad de una distancia de vista
+{
+    int slice = (int)floorf(logf(fmaxf(depth, CAMERA_NEAR) / CAMERA_NEAR) * depthScale);
+    return std::min(std::max(slice, 0), CLUSTER_Z - 1);
+}
+
+void BuildLightClusters() // Asignar luces a clusters en los workers y subir los SSBOs
+{
+    if (ClusterLights.empty() && ClusterEmptyUploaded)
+        return; // Sin luces: las listas vacías ya están en la GPU
+
+    TRACE_SCOPE("BuildLightClusters");
+    FrameClock::time_point start = FrameClock::now();
+
+    const float depthScale = CLUSTER_Z / logf(CLUSTER_FAR / CAMERA_NEAR);
+    const float xScale = ProjectionMatrix.m[0];
+    const float yScale = ProjectionMatrix.m[5];
+    if (ClusterAnimate)
+        ClusterAnimationTime += FrameDeltaSeconds;
+    const float time = ClusterAnimationTime;
+    const unsigned lightCount = (unsigned)ClusterLights.size();
+
+    // 1. Por luz: animar, copiar al formato GPU y calcular su caja de clusters
+    Jobs.ParallelFor(lightCount, 64, [&](unsigned begin, unsigned end)
+    {
+        TRACE_SCOPE("ClusterLightBounds");
+        for (unsigned i = begin; i < end; i++)
+        {
+            ClusterLight& light = ClusterLights[i];
+            light.position[1] = light.basePosition[1] + 0.25f * sinf(time * 1.3f + light.phase);
+
+            ClusterLightGPU& gpu = ClusterLightData[i];
+            memcpy(gpu.positionRange, light.position, sizeof(light.position));
+            gpu.positionRange[3] = light.range;
+            memcpy(gpu.color, light.color, sizeof(light.color));
+            gpu.color[3] = light.cosInner;
+            memcpy(gpu.directionCos, light.direction, sizeof(light.direction));
+            gpu.directionCos[3] = light.cosOuter;
+
+            ClusterLightBounds& bounds = ClusterBounds[i];
+            bounds.visible = false;
+
+            // Esfera en espacio de vista (z negativa delante de la cámara)
+            float center[3];
+            TransformPoint(&ViewMatrix, light.position, center);
+            float r = light.range;
+            float nearDepth = -center[2] - r;
+            float farDepth = -center[2] + r;
+            if (farDepth < CAMERA_NEAR)
+                continue; // Detrás de la cámara
+
+            // Proyectar la caja de la esfera recortada al plano cercano: su
+            // envolvente proyectada contiene a la esfera
+            float zNear = -fmaxf(nearDepth, CAMERA_NEAR);
+            float zFar = -farDepth;
+            float minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f;
+            for (int c = 0; c < 8; c++)
+            {
+                float x = center[0] + ((c & 1) ? r : -r);
+                float y = center[1] + ((c & 2) ? r : -r);
+                float z = (c & 4) ? zFar : zNear;
+                float ndcX = xScale * x / -z;
+                float ndcY = yScale * y / -z;
+                minX = fminf(minX, ndcX); maxX = fmaxf(maxX, ndcX);
+                minY = fminf(minY, ndcY); maxY = fmaxf(maxY, ndcY);
+            }
+            if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+                continue; // Fuera de la pantalla
+
+            bounds.x0 = (unsigned char)std::max((int)floorf((minX * 0.5f + 0.5f) * CLUSTER_X), 0);
+            bounds.x1 = (unsigned char)std::min((int)floorf((maxX * 0.5f + 0.5f) * CLUSTER_X), CLUSTER_X - 1);
+            bounds.y0 = (unsigned char)std::max((int)floorf((minY * 0.5f + 0.5f) * CLUSTER_Y), 0);
+            bounds.y1 = (unsigned char)std::min((int)floorf((maxY * 0.5f + 0.5f) * CLUSTER_Y), CLUSTER_Y - 1);
+            bounds.z0 = (unsigned char)ClusterSlice(nearDepth, depthScale);
+            bounds.z1 = (unsigned char)ClusterSlice(farDepth, depthScale);
+            bounds.visible = true;
+        }
+    });
+
+    // 2. Por corte de profundidad: listas de sus clusters (sin compartir escrituras)
+    ClusterRanges.resize(CLUSTER_COUNT * 2);
+    Jobs.ParallelFor(CLUSTER_Z, 1, [&](unsigned begin, unsigned end)
+    {
+        TRACE_SCOPE("ClusterSlice");
+        for (unsigned z = begin; z < end; z++)
+        {
+            // Contar luces por cluster del corte y convertir a offsets locales
+            unsigned* ranges = &ClusterRanges[z * CLUSTER_X * CLUSTER_Y * 2];
+            memset(ranges, 0, CLUSTER_X * CLUSTER_Y * 2 * sizeof(unsigned));
+            for (unsigned i = 0; i < lightCount; i++)
+            {
+                const ClusterLightBounds& b = ClusterBounds[i];
+                if (!b.visible || z < b.z0 || z > b.z1)
+                    continue;
+                for (int y = b.y0; y <= b.y1; y++)
+                    for (int x = b.x0; x <= b.x1; x++)
+                        ranges[(y * CLUSTER_X + x) * 2 + 1]++;
+            }
+
+            unsigned total = 0;
+            for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++)
+            {
+                ranges[c * 2] = total;
+                total += ranges[c * 2 + 1];
+            }
+
+            std::vector<unsigned>& indices = ClusterSliceIndices[z];
+            indices.resize(total);
+            std::vector<unsigned> cursor(CLUSTER_X * CLUSTER_Y);
+            for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++)
+                cursor[c] = ranges[c * 2];
+            for (unsigned i = 0; i < lightCount; i++)
+            {
+                const ClusterLightBounds& b = ClusterBounds[i];
+                if (!b.visible || z < b.z0 || z > b.z1)
+                    continue;
+                for (int y = b.y0; y <= b.y1; y++)
+                    for (int x = b.x0; x <= b.x1; x++)
+                        indices[cursor[y * CLUSTER_X + x]++] = i;
+            }
+        }
+    });
+
+    // 3. Unir los cortes: offsets globales y lista contigua
+    unsigned sliceBase[CLUSTER_Z];
+    unsigned total = 0;
+    ClusterMaxLights = 0;
+    for (int z = 0; z < CLUSTER_Z; z++)
+    {
+        sliceBase[z] = total;
+        total += (unsigned)ClusterSliceIndices[z].size();
+    }
+    ClusterIndices.resize(std::max(total, 1u)); // Un SSBO no puede estar vacío
+    Jobs.ParallelFor(CLUSTER_Z, 1, [&](unsigned begin, unsigned end)
+    {
+        for (unsigned z = begin; z < end; z++)
+        {
+            unsigned* ranges = &ClusterRanges[z * CLUSTER_X * CLUSTER_Y * 2];
+            for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++)
+                ranges[c * 2] += sliceBase[z];
+            if (!ClusterSliceIndices[z].empty())
+                memcpy(&ClusterIndices[sliceBase[z]], ClusterSliceIndices[z].data(),
+                       ClusterSliceIndices[z].size() * sizeof(unsigned));
+        }
+    });
+    for (int c = 0; c < CLUSTER_COUNT; c++)
+        ClusterMaxLights = std::max(ClusterMaxLights, ClusterRanges[c * 2 + 1]);
+    ClusterReferences = total;
+
+    // Subir (huérfanos cada frame: el driver no espera a la GPU)
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ClusterLightSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(ClusterLightData.size(), (size_t)1) * sizeof(ClusterLightGPU),
+                 ClusterLightData.empty() ? NULL : ClusterLightData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ClusterRangeSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, ClusterRanges.size() * sizeof(unsigned), ClusterRanges.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ClusterIndexSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, ClusterIndices.size() * sizeof(unsigned), ClusterIndices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    ClusterBuildMs = std::chrono::duration<float, std::milli>(FrameClock::now() - start).count();
+    ClusterEmptyUploaded = lightCount == 0;
+}
+
+void SetClusterUniforms(GLuint program) // Enlazar SSBOs y parámetros de la rejilla
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ClusterLightSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, ClusterRangeSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, ClusterIndexSSBO);
+
+    glUniform3i(glGetUniformLocation(program, "ClusterGrid"), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+    glUniform2f(glGetUniformLocation(program, "ClusterScale"),
+                (float)CLUSTER_X / std::max(RenderWidth, 1), (float)CLUSTER_Y / std::max(RenderHeight, 1));
+    glUniform1f(glGetUniformLocation(program, "ClusterNear"), CAMERA_NEAR);
+    glUniform1f(glGetUniformLocation(program, "ClusterDepthScale"), CLUSTER_Z / logf(CLUSTER_FAR / CAMERA_NEAR));
+}
+
+// =======================================================================
+// Depth Pre-Pass
+// =======================================================================
+void CreateDepthPrePass() // Crear programa del pre-pase de profundidad
+{
+    // Reutiliza el vertex shader principal (gl_Position invariante) con el
+    // fragment shader vacío del pase de sombras: la profundidad escrita es
+    // idéntica a la del pase principal y se puede usar GL_EQUAL
+    const ShaderStageSource stages[2] = {
+        { GL_VERTEX_SHADER, "SimpleShader.vertex.glsl", NULL, &ShaderIds[2] },
+        { GL_FRAGMENT_SHADER, "Shadow.fragment.glsl", NULL, &ShadowShaderIds[1] }
+    };
+    DepthPrePassProgram = CreateProgramCached("Depth pre-pass", stages, 2, [](GLuint program) {
+        DepthPrePassModelLoc      = glGetUniformLocation(program, "ModelMatrix");
+        DepthPrePassViewLoc       = glGetUniformLocation(program, "ViewMatrix");
+        DepthPrePassProjectionLoc = glGetUniformLocation(program, "ProjectionMatrix");
+    });
+}
+
+void RenderDepthPrePass() // Renderizar pre-pase de profundidad
+{
+    TRACE_SCOPE("RenderDepthPrePass");
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+
+    glUseProgram(DepthPrePassProgram);
+    glUniformMatrix4fv(DepthPrePassViewLoc, 1, GL_FALSE, ViewMatrix.m);
+    glUniformMatrix4fv(DepthPrePassProjectionLoc, 1, GL_FALSE, ProjectionMatrix.m);
+
+    for (size_t i = 0; i < SceneObjects.size(); i++)
+    {
+        const SceneObject& obj = SceneObjects[i];
+        glUniformMatrix4fv(DepthPrePassModelLoc, 1, GL_FALSE, obj.modelMatrix.m);
+        glBindVertexArray(obj.vao);
+        glDrawElements(GL_TRIANGLES, (GLsizei)obj.indexCount, GL_UNSIGNED_INT, 0);
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// =======================================================================
+// Screen-Space Shadow Mask
+// =======================================================================
+void CreateScreenShadowMask() // Crear programa de la máscara de sombras en pantalla
+{
+    const ShaderStageSource stages[2] = {
+        { GL_VERTEX_SHADER, "Fullscreen.vertex.glsl", NULL, NULL },
+        { GL_FRAGMENT_SHADER, "ScreenShadow.fragment.glsl", NULL, NULL }
+    };
+    // ShadowMap en la unidad 1 (SetShadowUniforms); el resto en unidades libres
+    ShadowMaskProgram = CreateProgramCached("Shadow mask", stages, 2, [](GLuint program) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "ShadowMap"), 1);
+        glUniform1i(glGetUniformLocation(program, "SceneDepth"), 5);
+        glUniform1i(glGetUniformLocation(program, "PrevSceneDepth"), 6);
+        glUniform1i(glGetUniformLocation(program, "PrevShadowMask"), 7);
+        glUseProgram(0);
+    });
+
+    glGenVertexArrays(1, &FullscreenVAO);
+}
+
+void CreateScreenTargets(int width, int height) // (Re)crear profundidad y máscaras al tamaño de la ventana
+{
+    glDeleteTextures(2, ScreenDepthTex);
+    glDeleteTextures(2, ShadowMaskTex);
+    if (!ScreenDepthFBO[0])
+    {
+        glGenFramebuffers(2, ScreenDepthFBO);
+        glGenFramebuffers(2, ShadowMaskFBO);
     }
-    
-    // 1. Renderizar pase de sombras
-    RenderShadowPass();
-    
-    // 2. Renderizar escena normal
-    glViewport(0, 0, CurrentWidth, CurrentHeight);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    DrawOBJ();
-    DrawGround();
+    glGenTextures(2, ScreenDepthTex);
+    glGenTextures(2, ShadowMaskTex);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindTexture(GL_TEXTURE_2D, ScreenDepthTex[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    glutSwapBuffers();
-    glutPostRedisplay();
+        glBindFramebuffer(GL_FRAMEBUFFER, ScreenDepthFBO[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, ScreenDepthTex[i], 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        glBindTexture(GL_TEXTURE_2D, ShadowMaskTex[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, ShadowMaskFBO[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ShadowMaskTex[i], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            printf("ERROR: Shadow mask framebuffer no está completo!\n");
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    ScreenTargetsWidth = width;
+    ScreenTargetsHeight = height;
+    ShadowMaskHistoryValid = false;
 }
 
-// =======================================================================
-// Idle
-// =======================================================================
-void IdleFunction(void) // Función de idle
+void RenderScreenShadowMask() // Profundidad de pantalla + máscara de sombras con acumulación temporal
 {
-    glutPostRedisplay();
+    TRACE_SCOPE("RenderScreenShadowMask");
+
+    if (ScreenTargetsWidth != RenderWidth || ScreenTargetsHeight != RenderHeight)
+        CreateScreenTargets(RenderWidth, RenderHeight);
+
+    ShadowMaskIndex ^= 1;
+    int current = ShadowMaskIndex;
+    int previous = current ^ 1;
+
+    // Profundidad de la escena (mismo programa que el pre-pase)
+    glBindFramebuffer(GL_FRAMEBUFFER, ScreenDepthFBO[current]);
+    glViewport(0, 0, RenderWidth, RenderHeight);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    RenderDepthPrePass();
+
+    // Máscara: una evaluación por píxel, mezclada con la historia reproyectada
+    glBindFramebuffer(GL_FRAMEBUFFER, ShadowMaskFBO[current]);
+    glDisable(GL_DEPTH_TEST);
+
+    Matrix viewProjection = MultiplyMatrices(&ViewMatrix, &ProjectionMatrix);
+    Matrix inverseViewProjection = InvertMatrix(&viewProjection);
+    Matrix prevInverseViewProjection = InvertMatrix(&PrevViewProjection);
+
+    glUseProgram(ShadowMaskProgram);
+    SetShadowUniforms(ShadowMaskProgram);
+    glUniformMatrix4fv(glGetUniformLocation(ShadowMaskProgram, "ViewMatrix"), 1, GL_FALSE, ViewMatrix.m);
+    glUniformMatrix4fv(glGetUniformLocation(ShadowMaskProgram, "InverseViewProjection"), 1, GL_FALSE, inverseViewProjection.m);
+    glUniformMatrix4fv(glGetUniformLocation(ShadowMaskProgram, "PrevViewProjection"), 1, GL_FALSE, PrevViewProjection.m);
+    glUniformMatrix4fv(glGetUniformLocation(ShadowMaskProgram, "PrevInverseViewProjection"), 1, GL_FALSE, prevInverseViewProjection.m);
+    glUniform1i(glGetUniformLocation(ShadowMaskProgram, "FrameIndex"), (GLint)TotalFrameCount);
+    glUniform1f(glGetUniformLocation(ShadowMaskProgram, "HistoryBlend"), ShadowMaskBlend);
+    glUniform1i(glGetUniformLocation(ShadowMaskProgram, "HistoryValid"), ShadowMaskHistoryValid ? 1 : 0);
+
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, ScreenDepthTex[current]);
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, ScreenDepthTex[previous]);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D, ShadowMaskTex[previous]);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindVertexArray(FullscreenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    PrevViewProjection = viewProjection;
+    ShadowMaskHistoryValid = true;
 }
 
 // =======================================================================
-// Timer
+// Dynamic Resolution
 // =======================================================================
-void TimerFunction(int Value) // Función de timer
+void UpdateRenderSize() // Resolución interna de la clase actual
 {
-    glutTimerFunc(250, TimerFunction, 1);
+    float scale = DynamicResolution ? RenderScaleForClass(RenderScaleClass) : 1.0f;
+    RenderWidth = std::max(1, (int)(CurrentWidth * scale + 0.5f));
+    RenderHeight = std::max(1, (int)(CurrentHeight * scale + 0.5f));
 }
 
-// =======================================================================
-// Clean
-// =======================================================================
-void CleanUp(void) // Función de limpieza
+float GpuFrameBudgetMs() // Tiempo de GPU objetivo por frame
 {
-    glDeleteProgram(ShaderIds[0]);
+    if (GpuBudgetMs > 0.0f)
+        return GpuBudgetMs;
+    float fps = PacingMode == PACING_CAPPED ? FrameCapFPS : 60.0f;
+    return 0.85f * 1000.0f / fps; // Margen para la CPU y el swap
 }
 
-// =======================================================================
-void CreateOBJ() // Crear modelo OBJ
+void SetRenderScaleClass(int sizeClass) // Cambiar de clase (los objetivos se realojan al usarlos)
 {
-    printf("Cargando modelo OBJ...\n");
+    RenderScaleClass = sizeClass;
+    RenderScaleCooldown = RENDER_SCALE_COOLDOWN;
+    RenderScaleUpSamples = 0;
+    RenderScaleChanges++;
+    UpdateRenderSize();
+    printf("Resolución dinámica: %.0f%% (%dx%d), GPU %.2f ms para %.2f ms\n",
+           100.0f * RenderScaleForClass(sizeClass), RenderWidth, RenderHeight, GpuFrameMsSmoothed, GpuFrameBudgetMs());
+}
 
-    std::vector<Vertex> verts;
-    std::vector<GLuint> idx;
+void UpdateDynamicResolution() // Controlador: consume la última muestra de GPU del frame completo
+{
+    const GpuTimer& timer = GpuTimers[GPU_TIMER_FRAME];
+    if (!DynamicResolution || IdleFullResolution || timer.sampleCount == RenderScaleSamples)
+        return;
+    RenderScaleSamples = timer.sampleCount;
 
-    if (!LoadOBJ("backpack_house.obj", verts, idx))
+    float ms = timer.lastMs;
+    GpuFrameMsSmoothed = GpuFrameMsSmoothed > 0.0f ? GpuFrameMsSmoothed + 0.25f * (ms - GpuFrameMsSmoothed) : ms;
+    if (RenderScaleCooldown > 0)
     {
-        printf("ERROR cargando OBJ.\n");
-        exit(1);
+        RenderScaleCooldown--; // La muestra aún puede ser de la clase anterior
+        return;
     }
 
-    IndexCount = idx.size();
-
-    // Crear shaders
-    ShaderIds[0] = glCreateProgram();
-    ShaderIds[1] = LoadShader("SimpleShader.fragment.glsl", GL_FRAGMENT_SHADER);
-    ShaderIds[2] = LoadShader("SimpleShader.vertex.glsl",   GL_VERTEX_SHADER);
-
-    glAttachShader(ShaderIds[0], ShaderIds[1]);
-    glAttachShader(ShaderIds[0], ShaderIds[2]);
-    glLinkProgram(ShaderIds[0]);
-
-    // Obtener ubicaciones de uniforms
-    ModelMatrixUniformLocation      = glGetUniformLocation(ShaderIds[0], "ModelMatrix");
-    ViewMatrixUniformLocation       = glGetUniformLocation(ShaderIds[0], "ViewMatrix");
-    ProjectionMatrixUniformLocation = glGetUniformLocation(ShaderIds[0], "ProjectionMatrix");
-
-    LightDirUniformLocation     = glGetUniformLocation(ShaderIds[0], "LightDir");
-    LightColorUniformLocation   = glGetUniformLocation(ShaderIds[0], "LightColor");
-    AmbientColorUniformLocation = glGetUniformLocation(ShaderIds[0], "AmbientColor");
-    MaterialColorUniformLocation= glGetUniformLocation(ShaderIds[0], "MaterialColor");
-    ViewPosUniformLocation      = glGetUniformLocation(ShaderIds[0], "ViewPos"); 
+    // Coste proporcional a los píxeles: escala con la que el frame cabría en el presupuesto
+    float budget = GpuFrameBudgetMs();
+    float fit = RenderScaleForClass(RenderScaleClass) * sqrtf(budget / std::max(GpuFrameMsSmoothed, 0.01f));
+    RenderScaleWanted = std::min(1.0f, std::max(RENDER_SCALE_MIN, fit));
 
-    
-    printf("Cargando textura...\n");
-    BaseColorTex = LoadTexture("T_CartoonHouse_Base_color1.jpg");  // Cambia esto por el nombre de tu textura
-    if (BaseColorTex == 0) {
-        printf("ERROR: No se pudo cargar la textura\n");
-        printf("Asegurate que el archivo este en el mismo directorio que el .exe\n");
-    } else {
-        printf("Textura cargada exitosamente (ID: %d)\n", BaseColorTex);
+    int target = RenderScaleClass;
+    if (GpuFrameMsSmoothed > budget)
+    {
+        // Por encima del presupuesto: bajar de inmediato a la clase que cabe
+        while (target > 0 && RenderScaleForClass(target) > fit)
+            target--;
+        RenderScaleUpSamples = 0;
+    }
+    else if (target < RENDER_SCALE_CLASSES - 1 && fit >= RenderScaleForClass(target + 1) * RENDER_SCALE_UP_MARGIN)
+    {
+        // Con margen: subir de una en una tras varias muestras seguidas
+        if (++RenderScaleUpSamples >= RENDER_SCALE_UP_SAMPLES)
+            target++;
     }
+    else
+        RenderScaleUpSamples = 0;
 
-    // Asignar unidades de textura
-    glUseProgram(ShaderIds[0]);
-    glUniform1i(glGetUniformLocation(ShaderIds[0], "BaseColor"), 0);
-    glUniform1i(glGetUniformLocation(ShaderIds[0], "ShadowMap"), 1);
-    glUseProgram(0);
+    if (target != RenderScaleClass)
+        SetRenderScaleClass(target);
+}
 
-    // Crear VAO/VBO/IBO
-    glGenVertexArrays(1, &BufferIds[0]);
-    glBindVertexArray(BufferIds[0]);
+bool SceneTargetActive() // El pase principal va al objetivo intermedio (escala < 1)
+{
+    return RenderWidth != CurrentWidth || RenderHeight != CurrentHeight;
+}
 
-    glGenBuffers(1, &BufferIds[1]);
-    glBindBuffer(GL_ARRAY_BUFFER, BufferIds[1]);
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(Vertex), verts.data(), GL_STATIC_DRAW);
+void CreateSceneTarget(int width, int height) // (Re)crear color y profundidad del pase principal
+{
+    glDeleteRenderbuffers(1, &SceneColorRB);
+    glDeleteRenderbuffers(1, &SceneDepthRB);
+    if (!SceneFBO)
+        glGenFramebuffers(1, &SceneFBO);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glGenRenderbuffers(1, &SceneColorRB);
+    glBindRenderbuffer(GL_RENDERBUFFER, SceneColorRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &SceneDepthRB);
+    glBindRenderbuffer(GL_RENDERBUFFER, SceneDepthRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-                        sizeof(Vertex),
-                        (void*)(sizeof(float)*3));
+    glBindFramebuffer(GL_FRAMEBUFFER, SceneFBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, SceneColorRB);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, SceneDepthRB);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        printf("ERROR: Scene framebuffer no está completo!\n");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE,
-                    sizeof(Vertex),
-                    (void*)(sizeof(float)*6));
+    SceneTargetWidth = width;
+    SceneTargetHeight = height;
+}
 
-    glGenBuffers(1, &BufferIds[2]);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, BufferIds[2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size()*sizeof(GLuint), idx.data(), GL_STATIC_DRAW);
+void BindMainTarget() // Framebuffer y viewport del pase principal
+{
+    if (SceneTargetActive())
+    {
+        if (SceneTargetWidth != RenderWidth || SceneTargetHeight != RenderHeight)
+            CreateSceneTarget(RenderWidth, RenderHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, SceneFBO);
+    }
+    else
+        glBindFramebuffer(GL_FRAMEBUFFER, 0); // Escala 1: directamente a la ventana
+    glViewport(0, 0, RenderWidth, RenderHeight);
+}
 
-    glBindVertexArray(0);
+void UpscaleMainTarget() // Llevar el pase principal a la ventana (blit bilineal)
+{
+    if (!SceneTargetActive())
+        return;
+
+    GpuTimerBegin(GPU_TIMER_UPSCALE);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, SceneFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, RenderWidth, RenderHeight, 0, 0, CurrentWidth, CurrentHeight,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, CurrentWidth, CurrentHeight);
+    GpuTimerEnd(GPU_TIMER_UPSCALE);
 }
 
 // =======================================================================
-// Create Shadow Map
+// Deferred Shading
 // =======================================================================
-void CreateShadowMap() // Crear mapa de sombras
+// Pase de geometría a un G-buffer compacto (albedo RGBA8, normal octaédrica
+// RG16 y profundidad) y un triángulo de pantalla completa que ilumina cada
+// píxel una sola vez con el mismo SimpleShader.fragment (variantes
+// SHADER_GBUFFER y SHADER_DEFERRED de la caché de permutaciones).
+void CreateGBuffer(int width, int height) // (Re)crear el G-buffer al tamaño de la ventana
 {
-    // Crear shader de sombras
-    ShadowShaderIds[0] = glCreateProgram();
-    ShadowShaderIds[1] = LoadShader("Shadow.fragment.glsl", GL_FRAGMENT_SHADER);
-    ShadowShaderIds[2] = LoadShader("Shadow.vertex.glsl", GL_VERTEX_SHADER);
-    
-    glAttachShader(ShadowShaderIds[0], ShadowShaderIds[1]);
-    glAttachShader(ShadowShaderIds[0], ShadowShaderIds[2]);
-    glLinkProgram(ShadowShaderIds[0]);
-
-    // Verificar si el shader compiló correctamente
-    GLint success;
-    glGetProgramiv(ShadowShaderIds[0], GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(ShadowShaderIds[0], 512, NULL, infoLog);
-        printf("ERROR: Shadow shader link failed:\n%s\n", infoLog);
-    } else {
-        printf("Shadow shader compilado OK\n");
-    }
-
-    // Crear framebuffer para sombras
-    glGenFramebuffers(1, &ShadowFBO);
-    
-    // Crear textura de profundidad
-    glGenTextures(1, &ShadowMap);
-    glBindTexture(GL_TEXTURE_2D, ShadowMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, 
-                SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    
-    // Adjuntar textura al framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, ShadowFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, ShadowMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    
-    // Verificar que el framebuffer esté completo
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        printf("ERROR: Shadow framebuffer no está completo!\n");
-    } else {
-        printf("Shadow framebuffer OK\n");
+    glDeleteTextures(1, &GBufferAlbedo);
+    glDeleteTextures(1, &GBufferNormal);
+    glDeleteTextures(1, &GBufferDepth);
+    if (!GBufferFBO)
+        glGenFramebuffers(1, &GBufferFBO);
+
+    GLuint* textures[3] = { &GBufferAlbedo, &GBufferNormal, &GBufferDepth };
+    const GLenum internalFormats[3] = { GL_RGBA8, GL_RG16, GL_DEPTH_COMPONENT24 };
+    const GLenum formats[3] = { GL_RGBA, GL_RG, GL_DEPTH_COMPONENT };
+    const GLenum types[3] = { GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_FLOAT };
+    for (int i = 0; i < 3; i++)
+    {
+        glGenTextures(1, textures[i]);
+        glBindTexture(GL_TEXTURE_2D, *textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
-    
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, GBufferFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, GBufferAlbedo, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, GBufferNormal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, GBufferDepth, 0);
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        printf("ERROR: G-buffer framebuffer no está completo!\n");
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    
-    // CREAR MATRIZ DE LUZ CORRECTAMENTE
-    // Usamos CreateProjectionMatrix en lugar de construirla manualmente
-    LightProjectionMatrix = IDENTITY_MATRIX;
-    
-    // Proyección ortográfica manual
-    float left = -10.0f;
-    float right = 10.0f;
-    float bottom = -10.0f;
-    float top = 10.0f;
-    float nearPlane = 1.0f;
-    float farPlane = 25.0f;
-    
-    LightProjectionMatrix.m[0] = 2.0f / (right - left);
-    LightProjectionMatrix.m[5] = 2.0f / (top - bottom);
-    LightProjectionMatrix.m[10] = -2.0f / (farPlane - nearPlane);
-    LightProjectionMatrix.m[12] = -(right + left) / (right - left);
-    LightProjectionMatrix.m[13] = -(top + bottom) / (top - bottom);
-    LightProjectionMatrix.m[14] = -(farPlane + nearPlane) / (farPlane - nearPlane);
-    LightProjectionMatrix.m[15] = 1.0f;
-    
-    // Vista de luz - colocar la luz mirando hacia el centro
-    LightViewMatrix = IDENTITY_MATRIX;
-    
-    // Posición de la luz: arriba y ligeramente al lado
-    // Dirección de luz es (0.3, 1.0, 0.5), así que posicionamos opuesta
-    TranslateMatrix(&LightViewMatrix, -3.0f, -10.0f, -5.0f);
-    
-    // Rotar para que mire hacia abajo al centro
-    RotateAboutxAxis(&LightViewMatrix, DegreesToRadians(-60.0f));
-    RotateAboutyAxis(&LightViewMatrix, DegreesToRadians(-17.0f));
-    
-    printf("Shadow mapping creado\n");
-    printf("Luz posicionada en: (-3, -10, -5) mirando hacia (0, -1, 0)\n");
+
+    GBufferWidth = width;
+    GBufferHeight = height;
+    printf("G-buffer %dx%d: %.1f MB (albedo RGBA8 + normal RG16 + profundidad D24)\n",
+           width, height, GBufferMemoryMB(width, height));
 }
 
-// =======================================================================
-// Render Shadow Pass
-// =======================================================================
-void RenderShadowPass() // Renderizar pase de sombras
+void RenderDeferred() // Pase de geometría + iluminación a pantalla completa
 {
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, ShadowFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    
-    // Habilitar culling para evitar peter panning
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_FRONT); // Renderizar caras traseras para sombras
-    
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    
-    glUseProgram(ShadowShaderIds[0]);
-    
-    Matrix lightSpaceMatrix = MultiplyMatrices(&LightProjectionMatrix, &LightViewMatrix);
-    
-    GLuint lightSpaceLoc = glGetUniformLocation(ShadowShaderIds[0], "LightSpaceMatrix");
-    GLuint modelLoc = glGetUniformLocation(ShadowShaderIds[0], "ModelMatrix");
-    
-    if (lightSpaceLoc == -1 || modelLoc == -1) {
-        printf("ERROR: No se encontraron uniforms en shadow shader\n");
-    }
-    
-    glUniformMatrix4fv(lightSpaceLoc, 1, GL_FALSE, lightSpaceMatrix.m);
+    TRACE_SCOPE("RenderDeferred");
 
-    // Renderizar objeto
-    ModelMatrix = IDENTITY_MATRIX;
-    float angle = AutoRotate ? DegreesToRadians(CubeRotationAngle) : DegreesToRadians(ManualRotationAngle);
-    TranslateMatrix(&ModelMatrix, ObjectPositionX, -1.0f, 0.0f);
-    RotateAboutyAxis(&ModelMatrix, angle);
-    ScaleMatrix(&ModelMatrix, 0.045f, 0.045f, 0.045f);
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, ModelMatrix.m);
-    glBindVertexArray(BufferIds[0]);
-    glDrawElements(GL_TRIANGLES, IndexCount, GL_UNSIGNED_INT, 0);
-    
-    // Renderizar suelo
-    ModelMatrix = IDENTITY_MATRIX;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, ModelMatrix.m);
-    glBindVertexArray(GroundVAO);
-    glDrawElements(GL_TRIANGLES, GroundIndexCount, GL_UNSIGNED_INT, 0);
-    
+    if (GBufferWidth != RenderWidth || GBufferHeight != RenderHeight)
+        CreateGBuffer(RenderWidth, RenderHeight);
+
+    // 1. Geometría: material y normal, sin luces
+    GpuTimerBegin(GPU_TIMER_GBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, GBufferFBO);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (GpuTimePerDraw) GpuTimerBegin(GPU_TIMER_DRAW_OBJ);
+    DrawOBJ();
+    if (GpuTimePerDraw) GpuTimerEnd(GPU_TIMER_DRAW_OBJ);
+    if (GpuTimePerDraw) GpuTimerBegin(GPU_TIMER_DRAW_GROUND);
+    DrawGround();
+    if (GpuTimePerDraw) GpuTimerEnd(GPU_TIMER_DRAW_GROUND);
+
+    BindMainTarget();
+    GpuTimerEnd(GPU_TIMER_GBUFFER);
+
+    // 2. Iluminación: un triángulo de pantalla completa, cada píxel se sombrea una vez
+    GpuTimerBegin(GPU_TIMER_DEFERRED_LIGHTING);
+    GLuint program = GetMainProgram(MainShaderKey(SHADER_DEFERRED));
+    glUseProgram(program);
+    glDisable(GL_DEPTH_TEST);
+
+    Matrix viewProjection = MultiplyMatrices(&ViewMatrix, &ProjectionMatrix);
+    Matrix inverseViewProjection = InvertMatrix(&viewProjection);
+    glUniformMatrix4fv(glGetUniformLocation(program, "ViewMatrix"), 1, GL_FALSE, ViewMatrix.m);
+    glUniformMatrix4fv(glGetUniformLocation(program, "InverseViewProjection"), 1, GL_FALSE, inverseViewProjection.m);
+    glUniform3fv(glGetUniformLocation(program, "ViewPos"), 1, CAMERA_POSITION);
+    glUniform3f(glGetUniformLocation(program, "LightColor"), 1.0f, 0.98f, 0.95f);
+    glUniform3f(glGetUniformLocation(program, "AmbientColor"), 0.25f, 0.23f, 0.20f);
+    SetShadowUniforms(program);
+    SetClusterUniforms(program);
+
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, GBufferAlbedo);
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, GBufferNormal);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D, GBufferDepth);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindVertexArray(FullscreenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
     glBindVertexArray(0);
+
+    glEnable(GL_DEPTH_TEST);
     glUseProgram(0);
-    
-    // Restaurar culling
-    glCullFace(GL_BACK);
-    glDisable(GL_CULL_FACE);
-    
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    
-    // Restaurar viewport
-    glViewport(0, 0, CurrentWidth, CurrentHeight);
+    GpuTimerEnd(GPU_TIMER_DEFERRED_LIGHTING);
 }
 
 // =======================================================================
@@ -666,41 +4955,195 @@ void KeyboardFunction(unsigned char key, int x, int y) // Función de teclado
         case 'A':
             ObjectPositionX -= 0.2f;
             break;
-            
-        case 'd': // Mover a la derecha
-        case 'D':
-            ObjectPositionX += 0.2f;
+            
+        case 'd': // Mover a la derecha
+        case 'D':
+            ObjectPositionX += 0.2f;
+            break;
+            
+        case 'r': // Activar/desactivar rotación automática
+        case 'R':
+            AutoRotate = !AutoRotate;
+            printf("Rotación automática: %s\n", AutoRotate ? "ON" : "OFF");
+            UpdateWindowTitle(); // Actualizar título inmediatamente
+            break;
+            
+        case 'q': // Rotar manualmente a la izquierda
+        case 'Q':
+            if (!AutoRotate) {
+                ManualRotationAngle -= 5.0f;
+            }
+            break;
+            
+        case 'e': // Rotar manualmente a la derecha
+        case 'E':
+            if (!AutoRotate) {
+                ManualRotationAngle += 5.0f;
+            }
+            break;
+            
+        case 'c': // Centrar objeto
+        case 'C':
+            ObjectPositionX = 0.0f;
+            ManualRotationAngle = 0.0f;
+            printf("Objeto centrado\n");
+            break;
+
+        case 'z': // Activar/desactivar pre-pase de profundidad
+        case 'Z':
+            DepthPrePass = !DepthPrePass;
+            printf("Pre-pase de profundidad: %s\n", DepthPrePass ? "ON" : "OFF");
+            UpdateWindowTitle();
+            break;
+
+        case 'x': // Alternar forward / diferido
+        case 'X':
+            DeferredShading = !DeferredShading;
+            ResetGpuTimerHistory(GPU_TIMER_MAIN); // Que el promedio sea del modo nuevo
+            printf("Sombreado: %s\n", DeferredShading ? "DIFERIDO" : "FORWARD");
+            UpdateWindowTitle();
+            break;
+
+        case 'p': // Volcar trazas de CPU a trace.json
+        case 'P':
+            WriteTraceJSON("trace.json");
+            break;
+
+        case 'k': // Cambiar número de cascadas (1..4)
+        case 'K':
+            ShadowCascadeCount = ShadowCascadeCount % MAX_SHADOW_CASCADES + 1;
+            printf("Cascadas de sombra: %d\n", ShadowCascadeCount);
+            UpdateWindowTitle();
+            break;
+
+        case 'o': // Activar/desactivar caché del shadow map
+        case 'O':
+            ShadowCaching = !ShadowCaching;
+            ShadowCacheValid = false;
+            printf("Caché de sombras: %s\n", ShadowCaching ? "ON" : "OFF");
+            UpdateWindowTitle();
+            break;
+
+        case 'u': // Activar/desactivar culling de proyectores de sombra
+        case 'U':
+            ShadowCasterCulling = !ShadowCasterCulling;
+            ShadowCacheValid = false;
+            printf("Culling de proyectores: %s\n", ShadowCasterCulling ? "ON" : "OFF");
+            UpdateWindowTitle();
+            break;
+
+        case 'l': // Cambiar número de focos con sombra (0, 4, 16, 64)
+        case 'L':
+            SpotLightCount = SpotLightCount == 0 ? 4 : SpotLightCount < MAX_SPOT_LIGHTS ? SpotLightCount * 4 : 0;
+            UpdateSpotLights();
+            printf("Focos con sombra: %d\n", SpotLightCount);
+            UpdateWindowTitle();
+            break;
+
+        case 't': // Cambiar número de luces puntuales con sombra (0, 2, 4, 8)
+        case 'T':
+            PointLightCount = PointLightCount == 0 ? 2 : PointLightCount < MAX_POINT_LIGHTS ? PointLightCount * 2 : 0;
+            UpdatePointLights();
+            printf("Luces puntuales con sombra: %d\n", PointLightCount);
+            UpdateWindowTitle();
+            break;
+
+        case 'n': // Cambiar presupuesto de actualización de sombras locales
+        case 'N':
+        {
+            const int budgetCount = sizeof(SHADOW_UPDATE_BUDGETS) / sizeof(SHADOW_UPDATE_BUDGETS[0]);
+            int next = 0;
+            for (int b = 0; b < budgetCount; b++)
+                if (SHADOW_UPDATE_BUDGETS[b] == ShadowUpdateBudget)
+                    next = (b + 1) % budgetCount;
+            ShadowUpdateBudget = SHADOW_UPDATE_BUDGETS[next];
+            if (ShadowUpdateBudget > 0)
+                printf("Presupuesto de sombras locales: %u triángulos por frame\n", ShadowUpdateBudget);
+            else
+                printf("Presupuesto de sombras locales: sin límite\n");
+            UpdateWindowTitle();
+            break;
+        }
+
+        case 'm': // Cambiar número de luces clustered (0, 256, 1024, 4096)
+        case 'M':
+            ClusterLightCount = ClusterLightCount == 0 ? 256 : ClusterLightCount < MAX_CLUSTER_LIGHTS ? ClusterLightCount * 4 : 0;
+            UpdateClusterLights();
+            printf("Luces clustered: %d\n", ClusterLightCount);
+            UpdateWindowTitle();
+            break;
+
+        case 'y': // Pausar/reanudar el balanceo de las luces clustered
+        case 'Y':
+            ClusterAnimate = !ClusterAnimate;
+            printf("Animación de luces clustered: %s\n", ClusterAnimate ? "ON" : "OFF");
+            break;
+
+        case 's': // Activar/desactivar máscara de sombras en pantalla
+        case 'S':
+            ScreenSpaceShadows = !ScreenSpaceShadows;
+            ShadowMaskHistoryValid = false;
+            printf("Sombras en espacio de pantalla: %s\n", ScreenSpaceShadows ? "ON" : "OFF");
+            UpdateWindowTitle();
+            break;
+
+        case 'h': // Activar/desactivar resolución dinámica
+        case 'H':
+            DynamicResolution = !DynamicResolution;
+            UpdateRenderSize();
+            printf("Resolución dinámica: %s (%dx%d)\n", DynamicResolution ? "ON" : "OFF", RenderWidth, RenderHeight);
+            UpdateWindowTitle();
+            break;
+
+        case 'j': // Activar/desactivar lightmap horneado del suelo
+        case 'J':
+            LightmapEnabled = !LightmapEnabled;
+            printf("Lightmap horneado: %s\n", LightmapEnabled ? "ON" : "OFF");
+            UpdateWindowTitle();
+            break;
+
+        case 'f': // Cambiar calidad del filtro de sombras (variante de shader)
+        case 'F':
+            SelectMainProgram((ShadowQuality + 1) % SHADOW_QUALITY_COUNT);
+            ResetGpuTimerHistory(GPU_TIMER_MAIN); // Que el promedio sea de la variante nueva
+            ShadowMomentsValid = false;
+            printf("Filtro de sombras: %s\n", ShadowQualityNames[ShadowQuality]);
+            UpdateWindowTitle();
+            break;
+
+        case '[': // Menos reducción de light bleeding (EVSM)
+            EvsmBleedReduction = fmaxf(EvsmBleedReduction - 0.05f, 0.0f);
+            printf("EVSM light bleeding reduction: %.2f\n", EvsmBleedReduction);
             break;
-            
-        case 'r': // Activar/desactivar rotación automática
-        case 'R':
-            AutoRotate = !AutoRotate;
-            if (AutoRotate) {
-                LastTime = 0; // Reiniciar el tiempo para rotación suave
-            }
-            printf("Rotación automática: %s\n", AutoRotate ? "ON" : "OFF");
-            UpdateWindowTitle(); // Actualizar título inmediatamente
+
+        case ']': // Más reducción de light bleeding (EVSM)
+            EvsmBleedReduction = fminf(EvsmBleedReduction + 0.05f, 0.95f);
+            printf("EVSM light bleeding reduction: %.2f\n", EvsmBleedReduction);
             break;
-            
-        case 'q': // Rotar manualmente a la izquierda
-        case 'Q':
-            if (!AutoRotate) {
-                ManualRotationAngle -= 5.0f;
-            }
+
+        case 'b': // Cambiar radio del desenfoque EVSM (0..4)
+        case 'B':
+            EvsmBlurRadius = (EvsmBlurRadius + 1) % 5;
+            ShadowMomentsValid = false;
+            printf("EVSM blur: %d texels (caja de %d)\n", EvsmBlurRadius, 2 * EvsmBlurRadius + 1);
             break;
-            
-        case 'e': // Rotar manualmente a la derecha
-        case 'E':
-            if (!AutoRotate) {
-                ManualRotationAngle += 5.0f;
-            }
+
+        case 'g': // Medir cada draw del pase principal en GPU
+        case 'G':
+            GpuTimePerDraw = !GpuTimePerDraw;
+            printf("Tiempos de GPU por draw: %s\n", GpuTimePerDraw ? "ON" : "OFF");
             break;
-            
-        case 'c': // Centrar objeto
-        case 'C':
-            ObjectPositionX = 0.0f;
-            ManualRotationAngle = 0.0f;
-            printf("Objeto centrado\n");
+
+        case 'v': // Cambiar modo de ritmo de frames (VSYNC -> CAP -> sin límite)
+        case 'V':
+            SetFramePacingMode((FramePacingMode)((PacingMode + 1) % 3));
+            UpdateWindowTitle();
+            break;
+
+        case 'i': // Permitir / impedir el reposo sin cambios
+        case 'I':
+            IdleSkipping = !IdleSkipping;
+            printf("Reposo sin cambios: %s\n", IdleSkipping ? "ON" : "OFF");
             break;
             
         case 27: // ESC para salir
@@ -708,6 +5151,7 @@ void KeyboardFunction(unsigned char key, int x, int y) // Función de teclado
             break;
     }
     
+    MarkSceneDirty();
     glutPostRedisplay();
 }
 
@@ -794,59 +5238,677 @@ void CreateGround() // Crear suelo
 
     glBindVertexArray(0);
 
+    // El suelo es estático: va a la capa estática de sombras
+    float boundsMin[3], boundsMax[3];
+    ComputeVertexBounds(groundVerts, boundsMin, boundsMax);
+    GroundObjectIndex = AddSceneObject("Ground", GroundVAO, GroundIndexCount, true, false, boundsMin, boundsMax);
+
+    // Receptor del lightmap: sus UV cubren [0, 1] sin solaparse
+    GroundVertices.swap(groundVerts);
+    GroundIndices.swap(groundIdx);
+    SetBakeGeometry(GroundObjectIndex, &GroundVertices, &GroundIndices, true);
+
     printf("Suelo creado\n");
 }
 
+// =======================================================================
+// Lightmap Baking
+// =======================================================================
+void SetBakeGeometry(int index, const std::vector<Vertex>* verts, const std::vector<GLuint>* idx, bool lightmapped) // Malla en CPU con la que el objeto entra en el horneado
+{
+    SceneObject& obj = SceneObjects[index];
+    obj.bakeVertices = verts;
+    obj.bakeIndices = idx;
+    obj.lightmapped = lightmapped;
+    obj.bakeHash = HashBytes(verts->data(), verts->size() * sizeof(Vertex), HASH_BYTES_SEED);
+    obj.bakeHash = HashBytes(idx->data(), idx->size() * sizeof(GLuint), obj.bakeHash);
+}
+
+unsigned long long LightmapSceneHash() // Clave del lightmap: parámetros, luz y mallas y transformaciones que intervienen
+{
+    const float params[4] = { (float)LIGHTMAP_SIZE, (float)LIGHTMAP_SAMPLES, SUN_ANGULAR_RADIUS, LIGHTMAP_SHADOW_STRENGTH };
+    unsigned long long hash = HashBytes(params, sizeof(params), HASH_BYTES_SEED);
+    hash = HashBytes(LightDirection, sizeof(LightDirection), hash);
+    for (size_t i = 0; i < SceneObjects.size(); i++)
+    {
+        const SceneObject& obj = SceneObjects[i];
+        if (!obj.bakeVertices || !(obj.castsShadows || obj.lightmapped))
+            continue;
+        const bool roles[2] = { obj.castsShadows, obj.lightmapped };
+        hash = HashBytes(roles, sizeof(roles), hash);
+        hash = HashBytes(&obj.bakeHash, sizeof(obj.bakeHash), hash);
+        hash = HashBytes(obj.modelMatrix.m, sizeof(obj.modelMatrix.m), hash);
+    }
+    return hash ? hash : 1; // 0 = sin lightmap
+}
+
+void BakeRangeBounds(const std::vector<BakeTriangle>& triangles, const std::vector<unsigned>& order,
+                     unsigned begin, unsigned end, float boundsMin[3], float boundsMax[3]) // AABB de los triángulos de un rango
+{
+    boundsMin[0] = boundsMin[1] = boundsMin[2] = 1e30f;
+    boundsMax[0] = boundsMax[1] = boundsMax[2] = -1e30f;
+    for (unsigned i = begin; i < end; i++)
+    {
+        const BakeTriangle& t = triangles[order[i]];
+        for (int k = 0; k < 3; k++)
+        {
+            float a = t.v0[k], b = t.v0[k] + t.e1[k], c = t.v0[k] + t.e2[k];
+            boundsMin[k] = fminf(boundsMin[k], fminf(a, fminf(b, c)));
+            boundsMax[k] = fmaxf(boundsMax[k], fmaxf(a, fmaxf(b, c)));
+        }
+    }
+}
+
+unsigned SplitBakeRange(std::vector<unsigned>& order, const std::vector<float>& centroids,
+                        unsigned begin, unsigned end) // Mediana por el eje más largo de los centroides
+{
+    float centroidMin[3] = { 1e30f, 1e30f, 1e30f }, centroidMax[3] = { -1e30f, -1e30f, -1e30f };
+    for (unsigned i = begin; i < end; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            centroidMin[k] = fminf(centroidMin[k], centroids[order[i] * 3 + k]);
+            centroidMax[k] = fmaxf(centroidMax[k], centroids[order[i] * 3 + k]);
+        }
+    }
+
+    int axis = 0;
+    for (int k = 1; k < 3; k++)
+        if (centroidMax[k] - centroidMin[k] > centroidMax[axis] - centroidMin[axis])
+            axis = k;
+
+    unsigned mid = (begin + end) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                     [&](unsigned a, unsigned b) { return centroids[a * 3 + axis] < centroids[b * 3 + axis]; });
+    return mid;
+}
+
+int BuildBakeNode(LightmapBake& bake, const std::vector<BakeTriangle>& triangles, std::vector<unsigned>& order,
+                  const std::vector<float>& centroids, unsigned begin, unsigned end) // Nodo de hasta cuatro hijos (devuelve su índice)
+{
+    // Partir el rango en dos y cada mitad grande otra vez: hasta cuatro hijos
+    unsigned ranges[4][2] = { { begin, end } };
+    int rangeCount = 1;
+    for (int level = 0; level < 2; level++)
+    {
+        int count = rangeCount;
+        for (int i = 0; i < count; i++)
+        {
+            if (ranges[i][1] - ranges[i][0] <= (unsigned)BAKE_LEAF_TRIANGLES)
+                continue;
+            unsigned mid = SplitBakeRange(order, centroids, ranges[i][0], ranges[i][1]);
+            ranges[rangeCount][0] = mid;
+            ranges[rangeCount][1] = ranges[i][1];
+            ranges[i][1] = mid;
+            rangeCount++;
+        }
+    }
+
+    int nodeIndex = (int)bake.nodes.size();
+    bake.nodes.push_back(BakeBVHNode());
+
+    for (int i = 0; i < 4; i++)
+    {
+        float boundsMin[3] = { 1e30f, 1e30f, 1e30f }, boundsMax[3] = { -1e30f, -1e30f, -1e30f };
+        int child = -1, count = 0;
+        if (i < rangeCount)
+        {
+            BakeRangeBounds(triangles, order, ranges[i][0], ranges[i][1], boundsMin, boundsMax);
+            if (ranges[i][1] - ranges[i][0] <= (unsigned)BAKE_LEAF_TRIANGLES)
+            {
+                child = (int)ranges[i][0]; // Hoja: el rango ya no se reordena
+                count = (int)(ranges[i][1] - ranges[i][0]);
+            }
+            else
+                child = BuildBakeNode(bake, triangles, order, centroids, ranges[i][0], ranges[i][1]);
+        }
+
+        BakeBVHNode& node = bake.nodes[nodeIndex]; // Tras la recursión (el vector pudo crecer)
+        for (int k = 0; k < 3; k++)
+        {
+            node.boundsMin[k][i] = boundsMin[k];
+            node.boundsMax[k][i] = boundsMax[k];
+        }
+        node.child[i] = child;
+        node.count[i] = count;
+    }
+    return nodeIndex;
+}
+
+void BuildBakeBVH(LightmapBake& bake) // Triángulos de los proyectores en espacio mundial y su BVH
+{
+    TRACE_SCOPE("BuildBakeBVH");
+
+    std::vector<BakeTriangle> triangles;
+    for (size_t i = 0; i < SceneObjects.size(); i++)
+    {
+        const SceneObject& obj = SceneObjects[i];
+        if (!obj.castsShadows || !obj.bakeVertices)
+            continue;
+
+        const std::vector<Vertex>& verts = *obj.bakeVertices;
+        const std::vector<GLuint>& idx = *obj.bakeIndices;
+        for (size_t t = 0; t + 2 < idx.size(); t += 3)
+        {
+            float p[3][3];
+            for (int k = 0; k < 3; k++)
+                TransformPoint(&obj.modelMatrix, verts[idx[t + k]].position, p[k]);
+
+            BakeTriangle tri;
+            for (int k = 0; k < 3; k++)
+            {
+                tri.v0[k] = p[0][k];
+                tri.e1[k] = p[1][k] - p[0][k];
+                tri.e2[k] = p[2][k] - p[0][k];
+            }
+            triangles.push_back(tri);
+        }
+    }
+
+    bake.nodes.clear();
+    bake.triangles.clear();
+    if (triangles.empty())
+        return; // Sin proyectores: todo iluminado
+
+    std::vector<unsigned> order(triangles.size());
+    std::vector<float> centroids(triangles.size() * 3);
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        order[i] = (unsigned)i;
+        for (int k = 0; k < 3; k++)
+            centroids[i * 3 + k] = triangles[i].v0[k] + (triangles[i].e1[k] + triangles[i].e2[k]) / 3.0f;
+    }
+    BuildBakeNode(bake, triangles, order, centroids, 0, (unsigned)triangles.size());
+
+    // Triángulos en el orden de las hojas
+    bake.triangles.resize(triangles.size());
+    for (size_t i = 0; i < order.size(); i++)
+        bake.triangles[i] = triangles[order[i]];
+}
+
+unsigned IntersectBakeBoxes(const BakeBVHNode& node, const float origin[3], const float invDir[3]) // Máscara de las cajas hijas que corta el rayo
+{
+#ifdef BAKE_SIMD
+    // Prueba de slabs de las cuatro cajas a la vez
+    __m128 tNear = _mm_setzero_ps();
+    __m128 tFar = _mm_set1_ps(1e30f);
+    for (int k = 0; k < 3; k++)
+    {
+        __m128 o = _mm_set1_ps(origin[k]);
+        __m128 inv = _mm_set1_ps(invDir[k]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMin[k]), o), inv);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMax[k]), o), inv);
+        tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+        tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+    }
+    return (unsigned)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        float tNear = 0.0f, tFar = 1e30f;
+        for (int k = 0; k < 3; k++)
+        {
+            float t0 = (node.boundsMin[k][i] - origin[k]) * invDir[k];
+            float t1 = (node.boundsMax[k][i] - origin[k]) * invDir[k];
+            tNear = fmaxf(tNear, fminf(t0, t1));
+            tFar = fminf(tFar, fmaxf(t0, t1));
+        }
+        if (tNear <= tFar)
+            mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+bool BakeRayOccluded(const LightmapBake& bake, const float origin[3], const float dir[3]) // Algún proyector corta el rayo (basta el primero)
+{
+    if (bake.nodes.empty())
+        return false;
+
+    float invDir[3] = { 1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2] };
+    int stack[64]; // Profundidad * 3 + 1 con divisiones por la mediana
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BakeBVHNode& node = bake.nodes[stack[--top]];
+        unsigned hits = IntersectBakeBoxes(node, origin, invDir);
+        for (int i = 0; i < 4; i++)
+        {
+            if (!(hits & (1u << i)) || node.child[i] < 0)
+                continue; // Huecos vacíos: su caja invertida no restringe el slab
+            if (node.count[i] == 0)
+            {
+                stack[top++] = node.child[i];
+                continue;
+            }
+            for (int t = node.child[i]; t < node.child[i] + node.count[i]; t++)
+            {
+                const BakeTriangle& tri = bake.triangles[t];
+                if (RayIntersectsTriangle(origin, dir, tri.v0, tri.e1, tri.e2, 1e30f))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+void RasterizeLightmapTexels(LightmapBake& bake) // Texels cubiertos por los receptores, con posición y normal
+{
+    TRACE_SCOPE("RasterizeLightmapTexels");
+
+    bake.texels.clear();
+    std::vector<bool> covered(LIGHTMAP_SIZE * LIGHTMAP_SIZE, false);
+    const float eps = 1e-4f; // Aristas compartidas: el primer triángulo se queda el texel
+
+    for (size_t o = 0; o < SceneObjects.size(); o++)
+    {
+        const SceneObject& obj = SceneObjects[o];
+        if (!obj.lightmapped || !obj.bakeVertices)
+            continue;
+
+        const std::vector<Vertex>& verts = *obj.bakeVertices;
+        const std::vector<GLuint>& idx = *obj.bakeIndices;
+        for (size_t t = 0; t + 2 < idx.size(); t += 3)
+        {
+            const Vertex* v[3] = { &verts[idx[t]], &verts[idx[t + 1]], &verts[idx[t + 2]] };
+            float px[3], py[3]; // UV en unidades de texel
+            for (int k = 0; k < 3; k++)
+            {
+                px[k] = v[k]->uv[0] * LIGHTMAP_SIZE;
+                py[k] = v[k]->uv[1] * LIGHTMAP_SIZE;
+            }
+            float area = (px[1] - px[0]) * (py[2] - py[0]) - (py[1] - py[0]) * (px[2] - px[0]);
+            if (fabsf(area) < 1e-12f)
+                continue;
+
+            int x0 = std::max(0, (int)floorf(fminf(px[0], fminf(px[1], px[2]))));
+            int x1 = std::min(LIGHTMAP_SIZE - 1, (int)ceilf(fmaxf(px[0], fmaxf(px[1], px[2]))));
+            int y0 = std::max(0, (int)floorf(fminf(py[0], fminf(py[1], py[2]))));
+            int y1 = std::min(LIGHTMAP_SIZE - 1, (int)ceilf(fmaxf(py[0], fmaxf(py[1], py[2]))));
+
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    // Baricéntricas del centro del texel
+                    float cx = x + 0.5f, cy = y + 0.5f;
+                    float w0 = ((px[1] - cx) * (py[2] - cy) - (py[1] - cy) * (px[2] - cx)) / area;
+                    float w1 = ((px[2] - cx) * (py[0] - cy) - (py[2] - cy) * (px[0] - cx)) / area;
+                    float w2 = 1.0f - w0 - w1;
+                    unsigned index = (unsigned)(y * LIGHTMAP_SIZE + x);
+                    if (w0 < -eps || w1 < -eps || w2 < -eps || covered[index])
+                        continue;
+                    covered[index] = true;
+
+                    float position[3], normal[3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        position[k] = w0 * v[0]->position[k] + w1 * v[1]->position[k] + w2 * v[2]->position[k];
+                        normal[k] = w0 * v[0]->normal[k] + w1 * v[1]->normal[k] + w2 * v[2]->normal[k];
+                    }
+
+                    LightmapTexel texel;
+                    TransformPoint(&obj.modelMatrix, position, texel.position);
+                    TransformDirection(&obj.modelMatrix, normal, texel.normal);
+                    float len = sqrtf(texel.normal[0] * texel.normal[0] + texel.normal[1] * texel.normal[1] +
+                                      texel.normal[2] * texel.normal[2]);
+                    for (int k = 0; k < 3; k++)
+                        texel.normal[k] /= len;
+                    texel.index = index;
+                    bake.texels.push_back(texel);
+                }
+            }
+        }
+    }
+}
+
+void BakeLightmapTexels(LightmapBake& bake, unsigned begin, unsigned end) // Sol con penumbra para un rango de texels (hilos del job system)
+{
+    float len = sqrtf(LightDirection[0] * LightDirection[0] + LightDirection[1] * LightDirection[1] +
+                      LightDirection[2] * LightDirection[2]);
+    float sun[3] = { LightDirection[0] / len, LightDirection[1] / len, LightDirection[2] / len };
+
+    // Base perpendicular al sol para repartir los rayos por su disco
+    float up[3] = { 0.0f, 1.0f, 0.0f };
+    if (fabsf(sun[1]) > 0.99f)
+    {
+        up[0] = 1.0f;
+        up[1] = 0.0f;
+    }
+    float tangent[3] = { up[1] * sun[2] - up[2] * sun[1], up[2] * sun[0] - up[0] * sun[2], up[0] * sun[1] - up[1] * sun[0] };
+    len = sqrtf(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+    for (int k = 0; k < 3; k++)
+        tangent[k] /= len;
+    float bitangent[3] = { sun[1] * tangent[2] - sun[2] * tangent[1], sun[2] * tangent[0] - sun[0] * tangent[2],
+                           sun[0] * tangent[1] - sun[1] * tangent[0] };
+    float spread = tanf(SUN_ANGULAR_RADIUS);
+
+    unsigned long long rays = 0;
+    for (unsigned t = begin; t < end; t++)
+    {
+        const LightmapTexel& texel = bake.texels[t];
+        float diff = fmaxf(texel.normal[0] * sun[0] + texel.normal[1] * sun[1] + texel.normal[2] * sun[2], 0.0f);
+        float origin[3];
+        for (int k = 0; k < 3; k++)
+            origin[k] = texel.position[k] + texel.normal[k] * 0.01f; // Evitar autointersección
+
+        // Espiral de Vogel en el disco del sol, girada por texel (ruido en vez de
+        // bandas). Primero un rayo de cada cuarto: si todos coinciden, el texel
+        // está fuera de la penumbra y no se trazan los demás
+        float rotation = 6.2831853f * fmodf(texel.index * 0.618034f, 1.0f);
+        int blocked = 0, traced = 0;
+        for (int i = 0; i < LIGHTMAP_SAMPLES; i++)
+        {
+            if (i == LIGHTMAP_PROBE_SAMPLES && (blocked == 0 || blocked == traced))
+                break;
+
+            int k = (i % LIGHTMAP_PROBE_SAMPLES) * (LIGHTMAP_SAMPLES / LIGHTMAP_PROBE_SAMPLES) + i / LIGHTMAP_PROBE_SAMPLES;
+            float r = spread * sqrtf((k + 0.5f) / LIGHTMAP_SAMPLES);
+            float angle = k * 2.3999632f + rotation; // Ángulo áureo
+            float dir[3];
+            for (int c = 0; c < 3; c++)
+                dir[c] = sun[c] + r * (cosf(angle) * tangent[c] + sinf(angle) * bitangent[c]);
+            float dirLen = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+            for (int c = 0; c < 3; c++)
+                dir[c] /= dirLen;
+
+            blocked += BakeRayOccluded(bake, origin, dir) ? 1 : 0;
+            traced++;
+        }
+        rays += traced;
+
+        float visibility = 1.0f - LIGHTMAP_SHADOW_STRENGTH * blocked / traced;
+        bake.data[texel.index * 2 + 0] = (unsigned char)(diff * visibility * 255.0f + 0.5f);
+        bake.data[texel.index * 2 + 1] = (unsigned char)(visibility * 255.0f + 0.5f);
+    }
+    bake.rays += rays;
+}
+
+void UploadLightmap(const std::vector<unsigned char>& data) // Subir el lightmap (RG8 con mipmaps)
+{
+    if (LightmapTex == 0)
+    {
+        glGenTextures(1, &LightmapTex);
+        glBindTexture(GL_TEXTURE_2D, LightmapTex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, LightmapTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, LIGHTMAP_SIZE, LIGHTMAP_SIZE, 0, GL_RG, GL_UNSIGNED_BYTE, data.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void LightmapCachePath(unsigned long long key, char* path, size_t size) // Archivo de la caché para un estado de la escena
+{
+    snprintf(path, size, "%s/%016llx.lm", LIGHTMAP_CACHE_DIR, key);
+}
+
+bool LoadLightmap(unsigned long long key) // Leer un lightmap horneado antes (false = no está o no vale)
+{
+    char path[64];
+    LightmapCachePath(key, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    // Cabecera: magia, ancho, alto
+    unsigned header[3] = {0};
+    std::vector<unsigned char> data(LIGHTMAP_SIZE * LIGHTMAP_SIZE * 2);
+    bool valid = fread(header, sizeof(header), 1, file) == 1 && header[0] == LIGHTMAP_CACHE_MAGIC &&
+                 header[1] == (unsigned)LIGHTMAP_SIZE && header[2] == (unsigned)LIGHTMAP_SIZE &&
+                 fread(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    if (!valid)
+    {
+        remove(path);
+        printf("AVISO: lightmap %s dañado, se hornea de nuevo\n", path);
+        return false;
+    }
+
+    UploadLightmap(data);
+    return true;
+}
+
+void SaveLightmap(unsigned long long key, const std::vector<unsigned char>& data) // Guardar un lightmap horneado
+{
+#ifdef _WIN32
+    _mkdir(LIGHTMAP_CACHE_DIR);
+#else
+    mkdir(LIGHTMAP_CACHE_DIR, 0755);
+#endif
+    char path[64];
+    LightmapCachePath(key, path, sizeof(path));
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return;
+    unsigned header[3] = { LIGHTMAP_CACHE_MAGIC, (unsigned)LIGHTMAP_SIZE, (unsigned)LIGHTMAP_SIZE };
+    bool written = fwrite(header, sizeof(header), 1, file) == 1 &&
+                   fwrite(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    if (!written)
+        remove(path); // No dejar lightmaps a medias
+}
+
+void CancelLightmapBake() // Descartar el horneado en curso
+{
+    ActiveBake.key = 0;
+    ActiveBake.triangles.clear();
+    ActiveBake.nodes.clear();
+    ActiveBake.texels.clear();
+    ActiveBake.data.clear();
+}
+
+void StartLightmapBake(unsigned long long key) // BVH de los proyectores y texels de los receptores del estado actual
+{
+    TRACE_SCOPE("StartLightmapBake");
+    FrameClock::time_point start = FrameClock::now();
+
+    ActiveBake.key = key;
+    BuildBakeBVH(ActiveBake);
+    RasterizeLightmapTexels(ActiveBake);
+    ActiveBake.data.assign(LIGHTMAP_SIZE * LIGHTMAP_SIZE * 2, 0);
+    ActiveBake.nextTexel = 0;
+    ActiveBake.rays.store(0);
+    ActiveBake.ms = std::chrono::duration<float, std::milli>(FrameClock::now() - start).count();
+
+    printf("Lightmap: horneando %zu texels contra %zu triángulos (BVH de %zu nodos, %.1f ms)\n",
+           ActiveBake.texels.size(), ActiveBake.triangles.size(), ActiveBake.nodes.size(), ActiveBake.ms);
+}
+
+void ContinueLightmapBake() // Hornear texels hasta agotar el presupuesto del frame
+{
+    TRACE_SCOPE("BakeLightmap");
+    FrameClock::time_point start = FrameClock::now();
+
+    unsigned total = (unsigned)ActiveBake.texels.size();
+    while (ActiveBake.nextTexel < total)
+    {
+        unsigned first = ActiveBake.nextTexel;
+        unsigned count = std::min(LIGHTMAP_BAKE_CHUNK, total - first);
+        Jobs.ParallelFor(count, 64, [&](unsigned begin, unsigned end)
+        {
+            TRACE_SCOPE("BakeLightmapTexels");
+            BakeLightmapTexels(ActiveBake, first + begin, first + end);
+        });
+        ActiveBake.nextTexel += count;
+
+        if (std::chrono::duration<float, std::milli>(FrameClock::now() - start).count() >= LIGHTMAP_BAKE_BUDGET_MS)
+            break;
+    }
+    ActiveBake.ms += std::chrono::duration<float, std::milli>(FrameClock::now() - start).count();
+    if (ActiveBake.nextTexel < total)
+        return;
+
+    UploadLightmap(ActiveBake.data);
+    SaveLightmap(ActiveBake.key, ActiveBake.data);
+    LightmapKey = ActiveBake.key;
+    LightmapBakeMs = ActiveBake.ms;
+    LightmapFromCache = false;
+    LightmapBakes++;
+    printf("Lightmap horneado: %dx%d, %.2f Mrayos en %.1f ms de CPU (%u hilos)\n",
+           LIGHTMAP_SIZE, LIGHTMAP_SIZE, ActiveBake.rays.load() / 1e6, ActiveBake.ms, Jobs.ThreadCount());
+    CancelLightmapBake(); // Liberar BVH y texels
+}
+
+void UpdateLightmap() // Invalidar, leer del disco u hornear el lightmap (una vez por frame, tras mover los objetos)
+{
+    TRACE_SCOPE("UpdateLightmap");
+
+    unsigned long long key = LightmapSceneHash();
+    LightmapStableFrames = key == LightmapSceneKey ? LightmapStableFrames + 1 : 0;
+    LightmapSceneKey = key;
+
+    if (ActiveBake.key != 0 && (ActiveBake.key != key || !LightmapEnabled))
+    {
+        CancelLightmapBake(); // Un proyector se movió: el resultado ya no valdría
+        printf("Lightmap: horneado cancelado\n");
+    }
+    if (!LightmapEnabled || key == LightmapKey)
+        return;
+
+    if (ActiveBake.key == 0)
+    {
+        if (LightmapStableFrames < (unsigned)LIGHTMAP_SETTLE_FRAMES)
+            return; // Esperar a que la escena se quede quieta
+        if (LoadLightmap(key))
+        {
+            LightmapKey = key;
+            LightmapFromCache = true;
+            LightmapCacheHits++;
+            printf("Lightmap: leído de %s/\n", LIGHTMAP_CACHE_DIR);
+            return;
+        }
+        StartLightmapBake(key);
+        return; // El BVH ya gastó parte del frame
+    }
+    ContinueLightmapBake();
+}
+
+bool LightmapActive() // Los receptores pueden usar el lightmap este frame
+{
+    return LightmapEnabled && LightmapTex != 0 && LightmapKey == LightmapSceneKey && !DeferredShading;
+}
+
 // =======================================================================
 // Draw OBJ
 // =======================================================================
-void DrawOBJ() // Dibujar modelo OBJ
+void UpdateObjectTransform() // Actualizar matriz de modelo del objeto (una vez por frame)
 {
     float angle;
-    clock_t now = clock();
 
     if (AutoRotate)
     {
-        if (LastTime == 0)
-            LastTime = now;
-
-        CubeRotationAngle += 15.0f * ((float)(now - LastTime) / CLOCKS_PER_SEC);
+        // 15 grados por segundo de tiempo real
+        CubeRotationAngle += 15.0f * FrameDeltaSeconds;
         angle = DegreesToRadians(CubeRotationAngle);
-        LastTime = now;
     }
     else
     {
         angle = DegreesToRadians(ManualRotationAngle);
     }
 
-    ModelMatrix = IDENTITY_MATRIX;
+    ObjectModelMatrix = IDENTITY_MATRIX;
+
+    TranslateMatrix(&ObjectModelMatrix, ObjectPositionX, -1.0f, 0.0f);
+    RotateAboutyAxis(&ObjectModelMatrix, angle);
+    ScaleMatrix(&ObjectModelMatrix, 0.045f, 0.045f, 0.045f);
+
+    SetObjectTransform(HouseObjectIndex, ObjectModelMatrix);
+}
+
+// =======================================================================
+// Scene Objects
+// =======================================================================
+int AddSceneObject(const char* name, GLuint vao, size_t indexCount, bool isStatic, bool castsShadows,
+                   const float boundsMin[3], const float boundsMax[3]) // Registrar un objeto en la escena
+{
+    SceneObject obj;
+    obj.name = name;
+    obj.vao = vao;
+    obj.indexCount = indexCount;
+    obj.modelMatrix = IDENTITY_MATRIX;
+    obj.isStatic = isStatic;
+    obj.castsShadows = castsShadows;
+    obj.transformDirty = true;
+    obj.shadowCascadeMask = ~0u;
+    obj.bakeVertices = NULL;
+    obj.bakeIndices = NULL;
+    obj.bakeHash = 0;
+    obj.lightmapped = false;
+    memcpy(obj.localMin, boundsMin, sizeof(obj.localMin));
+    memcpy(obj.localMax, boundsMax, sizeof(obj.localMax));
+    memcpy(obj.worldMin, boundsMin, sizeof(obj.worldMin));
+    memcpy(obj.worldMax, boundsMax, sizeof(obj.worldMax));
+    memcpy(obj.prevWorldMin, boundsMin, sizeof(obj.prevWorldMin));
+    memcpy(obj.prevWorldMax, boundsMax, sizeof(obj.prevWorldMax));
+
+    SceneObjects.push_back(obj);
+    return (int)SceneObjects.size() - 1;
+}
+
+void SetObjectTransform(int index, const Matrix& model) // Cambiar transformación (marca sucio si cambió)
+{
+    SceneObject& obj = SceneObjects[index];
+    if (memcmp(obj.modelMatrix.m, model.m, sizeof(model.m)) != 0)
+    {
+        obj.modelMatrix = model;
+        if (!obj.transformDirty) // Solo el primer cambio desde el último pase: conservar la AABB que hay en los mapas
+        {
+            memcpy(obj.prevWorldMin, obj.worldMin, sizeof(obj.prevWorldMin));
+            memcpy(obj.prevWorldMax, obj.worldMax, sizeof(obj.prevWorldMax));
+        }
+        obj.transformDirty = true;
+        TransformAABB(&obj.modelMatrix, obj.localMin, obj.localMax, obj.worldMin, obj.worldMax);
+    }
+}
+
+void ComputeVertexBounds(const std::vector<Vertex>& verts, float boundsMin[3], float boundsMax[3]) // AABB de un conjunto de vértices
+{
+    boundsMin[0] = boundsMin[1] = boundsMin[2] = 1e30f;
+    boundsMax[0] = boundsMax[1] = boundsMax[2] = -1e30f;
+
+    for (size_t i = 0; i < verts.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            boundsMin[k] = fminf(boundsMin[k], verts[i].position[k]);
+            boundsMax[k] = fmaxf(boundsMax[k], verts[i].position[k]);
+        }
+    }
+}
 
-    TranslateMatrix(&ModelMatrix, ObjectPositionX, -1.0f, 0.0f);
-    RotateAboutyAxis(&ModelMatrix, angle);
-    ScaleMatrix(&ModelMatrix, 0.045f, 0.045f, 0.045f);
+void DrawOBJ() // Dibujar modelo OBJ
+{
+    TRACE_SCOPE("DrawOBJ");
 
+    ModelMatrix = ObjectModelMatrix;
+
+    // Variante texturizada del pase actual (forward o G-buffer)
+    SetMainPassProgram(GetMainProgram(MainShaderKey(DeferredShading ? SHADER_GBUFFER | SHADER_TEXTURED : SHADER_TEXTURED)));
     glUseProgram(ShaderIds[0]);
     glUniformMatrix4fv(ModelMatrixUniformLocation, 1, GL_FALSE, ModelMatrix.m);
     glUniformMatrix4fv(ViewMatrixUniformLocation, 1, GL_FALSE, ViewMatrix.m);
     glUniformMatrix4fv(ProjectionMatrixUniformLocation, 1, GL_FALSE, ProjectionMatrix.m);
     
-    // LightSpaceMatrix para sombras
-    Matrix lightSpaceMatrix = MultiplyMatrices(&LightProjectionMatrix, &LightViewMatrix);
-    GLuint lightSpaceLoc = glGetUniformLocation(ShaderIds[0], "LightSpaceMatrix");
-    glUniformMatrix4fv(lightSpaceLoc, 1, GL_FALSE, lightSpaceMatrix.m);
-
-    glUniform1i(glGetUniformLocation(ShaderIds[0], "UseTexture"), 1);
+    // Cascadas de sombra (el pase de geometría diferido no ilumina)
+    if (!DeferredShading)
+    {
+        SetShadowUniforms(ShaderIds[0]);
+        SetClusterUniforms(ShaderIds[0]);
+    }
 
-    // Solo BaseColor y ShadowMap
+    // BaseColor (el ShadowMap lo enlaza SetShadowUniforms)
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, BaseColorTex);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, ShadowMap);
 
     // Posición de la cámara (inversa de ViewMatrix translation)
-    glUniform3f(ViewPosUniformLocation, 0.0f, 1.8f, 7.5f);
+    glUniform3fv(ViewPosUniformLocation, 1, CAMERA_POSITION);
 
-    glUniform3f(LightDirUniformLocation, 0.3f, 1.0f, 0.5f);
     glUniform3f(LightColorUniformLocation, 1.0f, 0.98f, 0.95f);
     glUniform3f(AmbientColorUniformLocation, 0.25f, 0.23f, 0.20f); // Reducir ambiente para ver sombras mejor
     glUniform3f(MaterialColorUniformLocation, 1.0f, 1.0f, 1.0f);
@@ -863,24 +5925,35 @@ void DrawOBJ() // Dibujar modelo OBJ
 // =======================================================================
 void DrawGround() // Dibujar suelo
 {
+    TRACE_SCOPE("DrawGround");
+
     ModelMatrix = IDENTITY_MATRIX;
 
+    // Con el lightmap al día el sol sale de una lectura; si su variante aún
+    // compila (o el mapa no vale) se ilumina con las cascadas
+    GLuint program = LightmapActive() ? GetMainProgram(MainShaderKey(SHADER_LIGHTMAP)) : 0;
+    if (program)
+    {
+        glActiveTexture(GL_TEXTURE9);
+        glBindTexture(GL_TEXTURE_2D, LightmapTex);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    else
+        program = GetMainProgram(MainShaderKey(DeferredShading ? SHADER_GBUFFER : 0));
+    SetMainPassProgram(program);
     glUseProgram(ShaderIds[0]);
 
     glUniformMatrix4fv(ModelMatrixUniformLocation, 1, GL_FALSE, ModelMatrix.m);
     glUniformMatrix4fv(ViewMatrixUniformLocation, 1, GL_FALSE, ViewMatrix.m);
     glUniformMatrix4fv(ProjectionMatrixUniformLocation, 1, GL_FALSE, ProjectionMatrix.m);
     
-    Matrix lightSpaceMatrix = MultiplyMatrices(&LightProjectionMatrix, &LightViewMatrix);
-    glUniformMatrix4fv(glGetUniformLocation(ShaderIds[0], "LightSpaceMatrix"), 1, GL_FALSE, lightSpaceMatrix.m);
-
-    glUniform1i(glGetUniformLocation(ShaderIds[0], "UseTexture"), 0);
-    
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, ShadowMap);
+    if (!DeferredShading)
+    {
+        SetShadowUniforms(ShaderIds[0]);
+        SetClusterUniforms(ShaderIds[0]);
+    }
 
-    glUniform3f(ViewPosUniformLocation, 0.0f, 1.8f, 7.5f);
-    glUniform3f(LightDirUniformLocation, 0.3f, 1.0f, 0.5f);
+    glUniform3fv(ViewPosUniformLocation, 1, CAMERA_POSITION);
     glUniform3f(LightColorUniformLocation, 1.0f, 0.98f, 0.95f);
     glUniform3f(AmbientColorUniformLocation, 0.25f, 0.23f, 0.20f); // Reducir ambiente
     glUniform3f(MaterialColorUniformLocation, 0.75f, 0.70f, 0.62f);